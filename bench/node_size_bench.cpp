@@ -0,0 +1,204 @@
+// Node size benchmark for the B+ tree.
+//
+// Every node_size_bench_<page> executable is built with BPT_PAGE_SIZE set to
+// <page>, so the same workload runs against trees whose nodes fill pages of
+// different sizes. Run them from a scratch directory:
+//
+//   node_size_bench_4096 [records] [pool MiB]
+//
+// For three trees shaped like the ones the system keeps, the workload
+// inserts records in random order, looks every key up, then removes half of
+// them. It reports wall time per phase, pages read into the buffer pool and
+// pages written back, internal node reads served from resident copies,
+// and the size of both files. The same workload then runs against the hash
+// indexes of pending orders and users.
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "../src/model/order.hpp"
+#include "../src/model/user.hpp"
+#include "../src/storage/bplus_tree.hpp"
+#include "../src/storage/buffer_pool.hpp"
+#include "../src/storage/extendible_hash.hpp"
+#include "../src/storage/wal.hpp"
+#include "../src/utilities/hash.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+uint64_t mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb3fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+// a permutation of [0, n), so each record is inserted once
+int scatter(int i, int n) { return static_cast<uint64_t>(i) * 1000003 % n; }
+
+double millis(Clock::time_point from) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - from)
+      .count();
+}
+
+void removeFiles(const std::string& name) {
+  std::filesystem::remove(name + ".index");
+  std::filesystem::remove(name + ".block");
+  std::filesystem::remove(name + ".hash");
+  std::filesystem::remove(name + ".dir");
+}
+
+struct PoolSnapshot {
+  size_t misses;
+  size_t write_backs;
+
+  static PoolSnapshot take() {
+    BufferPool& pool = BufferPool::instance();
+    return {pool.misses(), pool.writeBacks()};
+  }
+};
+
+void report(const char* phase, Clock::time_point start,
+            const PoolSnapshot& before) {
+  PoolSnapshot after = PoolSnapshot::take();
+  std::cout << "  " << phase << ": " << millis(start) << " ms, "
+            << after.misses - before.misses << " reads, "
+            << after.write_backs - before.write_backs << " write-backs\n";
+}
+
+// the timestamp keeps orders under one key distinct
+OrderRef makeOrder(int i) { return OrderRef{i, static_cast<uint64_t>(i)}; }
+
+template <class Key, class Value, class MakeKey, class MakeValue>
+void run(const char* title, int records, MakeKey make_key,
+         MakeValue make_value) {
+  std::string name = std::string("bench_") + title;
+  removeFiles(name);
+  {
+    BPT<Key, Value> tree(name);
+    std::cout << title << " (order " << defaultOrder<Key, Value>()
+              << ", leaf " << defaultLeafSize<Key, Value>() << ")\n";
+
+    PoolSnapshot before = PoolSnapshot::take();
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < records; ++i) {
+      int id = scatter(i, records);
+      tree.insert(make_key(id), make_value(id));
+    }
+    report("insert", start, before);
+
+    before = PoolSnapshot::take();
+    start = Clock::now();
+    size_t found = 0;
+    for (int i = 0; i < records; ++i) {
+      found += tree.find(make_key(mix(i) % records)).size();
+    }
+    report("find", start, before);
+
+    before = PoolSnapshot::take();
+    start = Clock::now();
+    for (int i = 0; i < records; i += 2) {
+      int id = scatter(i, records);
+      tree.remove(make_key(id), make_value(id));
+    }
+    report("remove", start, before);
+    std::cout << "  resident index: " << tree.residentIndexHits()
+              << " hits, " << tree.residentIndexLoads() << " loads\n";
+    if (found == 0) {
+      std::cout << "  nothing found\n";
+    }
+  }
+  std::cout << "  files: "
+            << std::filesystem::file_size(name + ".index") << " + "
+            << std::filesystem::file_size(name + ".block") << " bytes\n";
+  removeFiles(name);
+}
+
+template <class Value, class MakeKey, class MakeValue>
+void runHash(const char* title, int records, MakeKey make_key,
+             MakeValue make_value) {
+  std::string name = std::string("bench_") + title;
+  removeFiles(name);
+  {
+    ExtendibleHash<uint64_t, Value> index(name);
+    std::cout << title << " hash\n";
+
+    PoolSnapshot before = PoolSnapshot::take();
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < records; ++i) {
+      int id = scatter(i, records);
+      index.insert(make_key(id), make_value(id));
+    }
+    report("insert", start, before);
+
+    before = PoolSnapshot::take();
+    start = Clock::now();
+    size_t found = 0;
+    for (int i = 0; i < records; ++i) {
+      index.for_each(make_key(mix(i) % records), [&found](const Value&) {
+        found++;
+        return true;
+      });
+    }
+    report("find", start, before);
+
+    before = PoolSnapshot::take();
+    start = Clock::now();
+    for (int i = 0; i < records; i += 2) {
+      int id = scatter(i, records);
+      index.remove(make_key(id), make_value(id));
+    }
+    report("remove", start, before);
+    std::cout << "  global depth " << index.globalDepth() << "\n";
+    if (found == 0) {
+      std::cout << "  nothing found\n";
+    }
+  }
+  std::cout << "  files: " << std::filesystem::file_size(name + ".dir")
+            << " + " << std::filesystem::file_size(name + ".hash")
+            << " bytes\n";
+  removeFiles(name);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int records = argc > 1 ? std::stoi(argv[1]) : 200000;
+  size_t pool_mib = argc > 2 ? std::stoul(argv[2]) : 4;
+  WriteAheadLog::instance().setMode(WAL_NONE);
+  BufferPool::instance().setCapacity(pool_mib << 20);
+  std::cout << "page " << NODE_PAGE_SIZE << " bytes, " << records
+            << " records, pool " << pool_mib << " MiB\n";
+
+  run<uint64_t, OrderRef>(
+      "pending", records, [](int id) { return mix(id) % 4096; },
+      [](int id) { return makeOrder(id); });
+  run<FixedString<20>, OrderRef>(
+      "order", records,
+      [](int id) { return FixedString<20>("u" + std::to_string(id % 5000)); },
+      [](int id) { return makeOrder(id); });
+  run<uint64_t, FixedString<20>>(
+      "station", records,
+      [](int id) {
+        return Hash::hashKey<30>(
+            FixedString<30>("S" + std::to_string(id % 800)));
+      },
+      [](int id) { return FixedString<20>("T" + std::to_string(id)); });
+  runHash<OrderRef>(
+      "pending", records, [](int id) { return mix(id) % 4096; },
+      [](int id) { return makeOrder(id); });
+  runHash<User>(
+      "users", records,
+      [](int id) { return Hash::hashKey("u" + std::to_string(id)); },
+      [](int id) {
+        return User("u" + std::to_string(id), "pw", "name", "mail", 1);
+      });
+  return 0;
+}
@@ -0,0 +1,159 @@
+// Seat map kernel benchmark.
+//
+//   seat_kernel_bench [maps] [rounds]
+//
+// Runs the range minimum of query_ticket, the check-and-book of buy_ticket
+// and the release of refund_ticket over random segment ranges of a set of
+// full seat maps, once with the scalar loops and once with the kernels the
+// build picked (seatKernelName), and reports nanoseconds per call. Both
+// runs start from the same maps and their results are compared.
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "../src/model/seat.hpp"
+#include "../src/stl/vector.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+uint64_t mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb3fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+struct Query {
+  int map;
+  int start;
+  int end;
+  int seat;
+};
+
+double nanosPer(Clock::time_point from, size_t calls) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - from)
+             .count() /
+         calls;
+}
+
+sjtu::vector<SeatMap> makeMaps(int count) {
+  sjtu::vector<SeatMap> maps;
+  for (int m = 0; m < count; ++m) {
+    SeatMap map{};
+    map.total_seats = 20000;
+    map.station_num = MAX_STATION_NUM;
+    for (int i = 0; i < MAX_STATION_NUM; ++i) {
+      map.seat_num[i] = mix(m * 31 + i) % 20000;
+    }
+    maps.push_back(map);
+  }
+  return maps;
+}
+
+struct ScalarKernels {
+  static int rangeMin(const int* seats, int start, int end) {
+    return seatRangeMinScalar(seats, start, end);
+  }
+  static bool tryBook(int* seats, int start, int end, int seat) {
+    return seatTryBookScalar(seats, start, end, seat);
+  }
+  static void rangeAdd(int* seats, int start, int end, int delta) {
+    seatRangeAddScalar(seats, start, end, delta);
+  }
+};
+
+struct BuildKernels {
+  static int rangeMin(const int* seats, int start, int end) {
+    return seatRangeMin(seats, start, end);
+  }
+  static bool tryBook(int* seats, int start, int end, int seat) {
+    return seatTryBook(seats, start, end, seat);
+  }
+  static void rangeAdd(int* seats, int start, int end, int delta) {
+    seatRangeAdd(seats, start, end, delta);
+  }
+};
+
+// checksum of every result, so that both runs can be compared and the
+// calls are not optimised away
+template <class Kernels>
+uint64_t run(const char* name, const sjtu::vector<Query>& queries,
+             int maps_count, int rounds) {
+  sjtu::vector<SeatMap> maps = makeMaps(maps_count);
+  uint64_t sum = 0;
+  size_t calls = static_cast<size_t>(rounds) * queries.size();
+
+  Clock::time_point start = Clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    for (size_t q = 0; q < queries.size(); ++q) {
+      const Query& query = queries[q];
+      sum += Kernels::rangeMin(maps[query.map].seat_num, query.start,
+                               query.end);
+    }
+  }
+  double min_ns = nanosPer(start, calls);
+
+  start = Clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    for (size_t q = 0; q < queries.size(); ++q) {
+      const Query& query = queries[q];
+      sum += Kernels::tryBook(maps[query.map].seat_num, query.start,
+                              query.end, query.seat);
+    }
+  }
+  double book_ns = nanosPer(start, calls);
+
+  start = Clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    for (size_t q = 0; q < queries.size(); ++q) {
+      const Query& query = queries[q];
+      Kernels::rangeAdd(maps[query.map].seat_num, query.start, query.end,
+                        query.seat);
+    }
+  }
+  double release_ns = nanosPer(start, calls);
+
+  for (int m = 0; m < maps_count; ++m) {
+    for (int i = 0; i < MAX_STATION_NUM; ++i) {
+      sum = sum * 31 + maps[m].seat_num[i];
+    }
+  }
+  std::cout << name << ": range min " << min_ns << " ns, book " << book_ns
+            << " ns, release " << release_ns << " ns\n";
+  return sum;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  int maps_count = argc > 1 ? std::stoi(argv[1]) : 4096;
+  int rounds = argc > 2 ? std::stoi(argv[2]) : 200;
+  sjtu::vector<Query> queries;
+  for (int q = 0; q < 4096; ++q) {
+    uint64_t h = mix(q + 1);
+    int start = h % (MAX_STATION_NUM - 1);
+    int end = start + 1 + (h >> 16) % (MAX_STATION_NUM - start);
+    // large enough that some books fail
+    int seat = 1 + (h >> 32) % 2000;
+    queries.push_back(Query{static_cast<int>((h >> 40) % maps_count), start,
+                            end, seat});
+  }
+  std::cout << maps_count << " maps of " << MAX_STATION_NUM << " segments, "
+            << queries.size() << " ranges, " << rounds << " rounds\n";
+
+  uint64_t expected =
+      run<ScalarKernels>("scalar", queries, maps_count, rounds);
+  uint64_t got =
+      run<BuildKernels>(seatKernelName(), queries, maps_count, rounds);
+  if (got != expected) {
+    std::cout << "results differ\n";
+    return 1;
+  }
+  return 0;
+}
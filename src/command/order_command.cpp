@@ -19,19 +19,27 @@ void QueryTicketHandler::execute(const ParamMap& params,
   Date date{std::stoi(date_str.substr(0, 2)), std::stoi(date_str.substr(3))};
   std::string start_station = params.get('s');
   std::string end_station = params.get('t');
-  sjtu::vector<FixedString<20>> result =
-      train_manager.queryRoute({start_station, end_station});
-
-  size_t i = 0, j = 0;
 
   ComparisonOrder order =
       params.has('p') ? (params.get('p') == "time" ? TIME : COST) : TIME;
 
+  // the candidates are collected first, so that their trains and then
+  // their seat maps are each read in one batch
+  sjtu::vector<FixedString<20>> train_ids;
+  train_manager.queryRoute({start_station, end_station},
+                           [&](const FixedString<20>& train_id) {
+                             train_ids.push_back(train_id);
+                             return true;
+                           });
+  train_manager.prefetchTrains(train_ids);
+
   sjtu::vector<TicketInfo> tickets(30);
   int idx = 0;
   sjtu::vector<TicketOrder> ticket_order(30);
+  sjtu::vector<int> seat_starts, seat_dates, start_indices, end_indices;
   Train train;
-  for (auto& train_id : result) {
+  for (size_t k = 0; k < train_ids.size(); ++k) {
+    const FixedString<20>& train_id = train_ids[k];
     train_manager.queryTrain(train_id, train);
     int start_index = train.queryStationIndex(start_station);
     int end_index = train.queryStationIndex(end_station);
@@ -43,16 +51,15 @@ void QueryTicketHandler::execute(const ParamMap& params,
         origin_date > train.sale_date_end) {
       continue;
     }
-    int pos;
-    int seats = seat_manager
-                    .querySeat(train.seat_map_pos, pos,
-                               origin_date - train.sale_date_start)
-                    .queryAvailableSeat(start_index, end_index);
+    seat_starts.push_back(train.seat_map_pos);
+    seat_dates.push_back(origin_date - train.sale_date_start);
+    start_indices.push_back(start_index);
+    end_indices.push_back(end_index);
     tickets.push_back(TicketInfo(
         train_id, start_station, end_station,
         TimePoint(origin_date, train.departure_times[start_index]),
         TimePoint(origin_date, train.arrival_times[end_index]), origin_date,
-        train.prices[end_index] - train.prices[start_index], seats));
+        train.prices[end_index] - train.prices[start_index], 0));
 
     idx++;
     if (order == TIME) {
@@ -61,6 +68,12 @@ void QueryTicketHandler::execute(const ParamMap& params,
       ticket_order.push_back({tickets[idx - 1].price, idx - 1, train_id});
     }
   }
+  seat_manager.prefetchSeats(seat_starts, seat_dates);
+  for (int i = 0; i < idx; ++i) {
+    SeatMap seat_map = seat_manager.querySeat(seat_starts[i], seat_dates[i]);
+    tickets[i].seats =
+        seat_map.queryAvailableSeat(start_indices[i], end_indices[i]);
+  }
   if (idx == 0) {
     std::cout << "0\n";
     return;
@@ -73,6 +86,141 @@ void QueryTicketHandler::execute(const ParamMap& params,
   }
 }
 
+QueryTicketRangeHandler::QueryTicketRangeHandler(TrainManager& train_manager,
+                                                 SeatManager& seat_manager)
+    : train_manager(train_manager), seat_manager(seat_manager) {}
+
+void QueryTicketRangeHandler::execute(const ParamMap& params,
+                                      const std::string& timestamp) {
+  std::cout << '[' << timestamp << "] ";
+  std::string first_str = params.get('d');
+  std::string last_str = params.get('e');
+  Date first{std::stoi(first_str.substr(0, 2)),
+             std::stoi(first_str.substr(3))};
+  Date last{std::stoi(last_str.substr(0, 2)), std::stoi(last_str.substr(3))};
+  if (last < first) {
+    std::cout << "-1\n";
+    return;
+  }
+  int days = last - first + 1;
+  std::string start_station = params.get('s');
+  std::string end_station = params.get('t');
+
+  ComparisonOrder order =
+      params.has('p') ? (params.get('p') == "time" ? TIME : COST) : TIME;
+
+  sjtu::vector<FixedString<20>> train_ids;
+  train_manager.queryRoute({start_station, end_station},
+                           [&](const FixedString<20>& train_id) {
+                             train_ids.push_back(train_id);
+                             return true;
+                           });
+  train_manager.prefetchTrains(train_ids);
+
+  // a candidate is on sale on the days [first_day, end_day) of the span;
+  // on day k of the span its train sets off on origins[c] + k
+  sjtu::vector<TicketInfo> tickets;
+  sjtu::vector<int> first_days, end_days, seat_dates;
+  sjtu::vector<Date> origins;
+  sjtu::vector<Time> departures, arrivals;
+  sjtu::vector<int> seat_starts, start_indices, end_indices;
+  sjtu::vector<TicketOrder> ticket_order;
+  sjtu::vector<int> prefetch_starts, prefetch_dates;
+  Train train;
+  for (size_t k = 0; k < train_ids.size(); ++k) {
+    const FixedString<20>& train_id = train_ids[k];
+    train_manager.queryTrain(train_id, train);
+    int start_index = train.queryStationIndex(start_station);
+    int end_index = train.queryStationIndex(end_station);
+    if (start_index == -1 || end_index == -1 || start_index >= end_index) {
+      continue;
+    }
+    int offset = train.departure_times[start_index].hour / 24;
+    Date first_origin = first - offset;
+    Date last_origin = last - offset;
+    if (last_origin < train.sale_date_start ||
+        first_origin > train.sale_date_end) {
+      continue;
+    }
+    int first_day = first_origin < train.sale_date_start
+                        ? train.sale_date_start - first_origin
+                        : 0;
+    int end_day = last_origin > train.sale_date_end
+                      ? days - (last_origin - train.sale_date_end)
+                      : days;
+    int seat_date = first_origin + first_day - train.sale_date_start;
+    for (int day = first_day; day < end_day; ++day) {
+      prefetch_starts.push_back(train.seat_map_pos);
+      prefetch_dates.push_back(seat_date + day - first_day);
+    }
+    first_days.push_back(first_day);
+    end_days.push_back(end_day);
+    seat_dates.push_back(seat_date);
+    origins.push_back(first_origin);
+    departures.push_back(train.departure_times[start_index]);
+    arrivals.push_back(train.arrival_times[end_index]);
+    seat_starts.push_back(train.seat_map_pos);
+    start_indices.push_back(start_index);
+    end_indices.push_back(end_index);
+    // the ticket of the first day on sale; only its dates and seats
+    // change from day to day
+    tickets.push_back(TicketInfo(
+        train_id, start_station, end_station,
+        TimePoint(first_origin + first_day, train.departure_times[start_index]),
+        TimePoint(first_origin + first_day, train.arrival_times[end_index]),
+        first_origin + first_day,
+        train.prices[end_index] - train.prices[start_index], 0));
+    int idx = tickets.size() - 1;
+    // minutes and price are the same every day, so one order serves all
+    ticket_order.push_back({order == TIME ? tickets[idx].minutes
+                                          : tickets[idx].price,
+                            idx, train_id});
+  }
+  seat_manager.prefetchSeats(prefetch_starts, prefetch_dates);
+
+  // seats[c][day], read for each candidate over its days in one pass
+  sjtu::vector<sjtu::vector<int>> seats;
+  sjtu::vector<SeatMap> seat_maps;
+  for (size_t c = 0; c < tickets.size(); ++c) {
+    seat_maps.clear();
+    seat_manager.querySeats(seat_starts[c], seat_dates[c],
+                            end_days[c] - first_days[c], seat_maps);
+    sjtu::vector<int> row;
+    for (size_t k = 0; k < seat_maps.size(); ++k) {
+      row.push_back(
+          seat_maps[k].queryAvailableSeat(start_indices[c], end_indices[c]));
+    }
+    seats.push_back(row);
+  }
+  if (!ticket_order.empty()) {
+    mergeSort(ticket_order, 0, ticket_order.size() - 1);
+  }
+
+  std::cout << days << '\n';
+  for (int day = 0; day < days; ++day) {
+    int count = 0;
+    for (size_t k = 0; k < ticket_order.size(); ++k) {
+      int c = ticket_order[k].index;
+      if (first_days[c] <= day && day < end_days[c]) {
+        count++;
+      }
+    }
+    std::cout << (first + day).toString() << ' ' << count << '\n';
+    for (size_t k = 0; k < ticket_order.size(); ++k) {
+      int c = ticket_order[k].index;
+      if (day < first_days[c] || day >= end_days[c]) {
+        continue;
+      }
+      Date origin = origins[c] + day;
+      TicketInfo ticket(tickets[c].train_id, tickets[c].from, tickets[c].to,
+                        TimePoint(origin, departures[c]),
+                        TimePoint(origin, arrivals[c]), origin,
+                        tickets[c].price, seats[c][day - first_days[c]]);
+      std::cout << ticket.format() << '\n';
+    }
+  }
+}
+
 BuyTicketHandler::BuyTicketHandler(TrainManager& train_manager,
                                    SeatManager& seat_manager,
                                    UserManager& user_manager,
@@ -114,9 +262,8 @@ void BuyTicketHandler::execute(const ParamMap& params,
     std::cout << "-1\n";
     return;
   }
-  int seat_map_pos;
-  SeatMap seat_map = seat_manager.querySeat(train.seat_map_pos, seat_map_pos,
-                                            start_date - train.sale_date_start);
+  int seat_date = start_date - train.sale_date_start;
+  SeatMap seat_map = seat_manager.querySeat(train.seat_map_pos, seat_date);
 
   if (timestamp == "3514") {
     std::cerr << "SeatMap: ";
@@ -129,8 +276,9 @@ void BuyTicketHandler::execute(const ParamMap& params,
     std::cout << "-1\n";
     return;
   }
-  int booked = seat_manager.bookSeat(seat_map_pos, start_index, end_index,
-                                     ticket_num, seat_map);
+  int booked = seat_manager.bookSeat(train.seat_map_pos, seat_date,
+                                     start_index, end_index, ticket_num,
+                                     seat_map);
   if (booked == -1) {
     if (wait) {
       Order order(std::move(username), std::move(train_id), start_date,
@@ -140,8 +288,8 @@ void BuyTicketHandler::execute(const ParamMap& params,
                   TimePoint(start_date, train.arrival_times[end_index]),
                   ticket_num, std::stoi(timestamp),
                   train.prices[end_index] - train.prices[start_index], PENDING);
-      order_manager.addOrder(order);
-      order_manager.addPendingOrder(order);
+      uint64_t rid = order_manager.addOrder(order);
+      order_manager.addPendingOrder(order, rid);
       std::cout << "queue\n";
     } else {
       std::cout << "-1\n";
@@ -199,18 +347,18 @@ void RefundTicketHandler::execute(const ParamMap& params,
     return;
   }
   int order_id = params.has('n') ? std::stoi(params.get('n')) : 1;
-  sjtu::vector<Order> orders = order_manager.queryOrder(username);
-  if (orders.size() < order_id || order_id <= 0) {
+  Order order;
+  uint64_t rid;
+  if (order_manager.queryOrder(username, order_id, order, rid) == -1) {
     std::cout << "-1\n";
     return;
   }
-  Order& order = orders[orders.size() - order_id];
   if (order.status == REFUNDED) {
     std::cout << "-1\n";
     return;
   }
   if (order.status == PENDING) {
-    order_manager.updateOrderStatus(username, order, REFUNDED);
+    order_manager.updateOrderStatus(rid, REFUNDED);
     order_manager.removeFromPending(order.train_id, order.origin_station_date,
                                     order);
     std::cout << "0\n";
@@ -225,33 +373,29 @@ void RefundTicketHandler::execute(const ParamMap& params,
   int start_index = train.queryStationIndex(order.from);
   int end_index = train.queryStationIndex(order.to);
   Date date = order.origin_station_date;
-  int seat_map_pos;
-  SeatMap seat_map = seat_manager.querySeat(train.seat_map_pos, seat_map_pos,
-                                            date - train.sale_date_start);
-  seat_manager.releaseSeat(seat_map_pos, start_index, end_index,
-                           order.ticket_num, seat_map);
-  order_manager.updateOrderStatus(username, order, REFUNDED);
-  sjtu::vector<Order> pending_orders = order_manager.queryPendingOrder(
-      order.train_id, order.origin_station_date);
-  if (pending_orders.empty()) {
-    std::cout << "0\n";
-    return;
-  }
+  int seat_date = date - train.sale_date_start;
+  SeatMap seat_map = seat_manager.querySeat(train.seat_map_pos, seat_date);
+  seat_manager.releaseSeat(train.seat_map_pos, seat_date, start_index,
+                           end_index, order.ticket_num, seat_map);
+  order_manager.updateOrderStatus(rid, REFUNDED);
   sjtu::vector<Order> need_to_remove;
-  for (auto& pending_order : pending_orders) {
-    if (pending_order.start_station_index >= end_index ||
-        pending_order.end_station_index <= start_index) {
-      continue;
-    }
-    int booked = seat_manager.bookSeat(
-        seat_map_pos, pending_order.start_station_index,
-        pending_order.end_station_index, pending_order.ticket_num, seat_map);
-    if (booked == 0) {
-      order_manager.updateOrderStatus(pending_order.username, pending_order,
-                                      SUCCESS);
-      need_to_remove.push_back(pending_order);
-    }
-  }
+  order_manager.queryPendingOrder(
+      order.train_id, date,
+      [&](const Order& pending_order, uint64_t pending_rid) {
+        if (pending_order.start_station_index >= end_index ||
+            pending_order.end_station_index <= start_index) {
+          return true;
+        }
+        int booked = seat_manager.bookSeat(
+            train.seat_map_pos, seat_date, pending_order.start_station_index,
+            pending_order.end_station_index, pending_order.ticket_num,
+            seat_map);
+        if (booked == 0) {
+          order_manager.updateOrderStatus(pending_rid, SUCCESS);
+          need_to_remove.push_back(pending_order);
+        }
+        return true;
+      });
   for (int i = (int)need_to_remove.size() - 1; i >= 0; --i) {
     order_manager.removeFromPending(order.train_id, date, need_to_remove[i]);
   }
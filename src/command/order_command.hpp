@@ -25,33 +25,47 @@ struct CostComparatorForQuery {
   }
 };
 
+// sort key of a ticket in the query_ticket output: its minutes or price
+struct TicketOrder {
+  int value;
+  int index;
+  FixedString<20> train_id;
+  bool operator<(const TicketOrder& other) const {
+    return value < other.value ||
+           (value == other.value && train_id < other.train_id);
+  }
+  bool operator>(const TicketOrder& other) const {
+    return value > other.value ||
+           (value == other.value && train_id > other.train_id);
+  }
+  bool operator==(const TicketOrder& other) const {
+    return value == other.value && train_id == other.train_id;
+  }
+};
+
 class QueryTicketHandler : public CommandHandler {
  private:
   TrainManager& train_manager;
   SeatManager& seat_manager;
 
-  struct TicketOrder {
-    int value;
-    int index;
-    FixedString<20> train_id;
-    bool operator<(const TicketOrder& other) const {
-      return value < other.value ||
-             (value == other.value && train_id < other.train_id);
-    }
-    bool operator>(const TicketOrder& other) const {
-      return value > other.value ||
-             (value == other.value && train_id > other.train_id);
-    }
-    bool operator==(const TicketOrder& other) const {
-      return value == other.value && train_id == other.train_id;
-    }
-  };
-
  public:
   QueryTicketHandler(TrainManager& train_manager, SeatManager& seat_manager);
   void execute(const ParamMap& params, const std::string& timestamp) override;
 };
 
+// query_ticket for every date from -d to -e: the route's trains are read
+// once, and each train's seats for the whole span are read day after day
+class QueryTicketRangeHandler : public CommandHandler {
+ private:
+  TrainManager& train_manager;
+  SeatManager& seat_manager;
+
+ public:
+  QueryTicketRangeHandler(TrainManager& train_manager,
+                          SeatManager& seat_manager);
+  void execute(const ParamMap& params, const std::string& timestamp) override;
+};
+
 class BuyTicketHandler : public CommandHandler {
  private:
   TrainManager& train_manager;
@@ -3,11 +3,14 @@
 #include <filesystem>
 #include <iostream>
 
+#include "../storage/wal.hpp"
+
 void ExitHandler::execute(const ParamMap& params,
                           const std::string& timestamp) {
   std::cout << '[' << timestamp << "] ";
   std::cout << "bye";
-  exit(0);
+  // main leaves its loop after this command so that every manager is
+  // destroyed and the buffer pool writes its dirty pages back
 }
 
 void CleanHandler::execute(const ParamMap& params,
@@ -17,13 +20,30 @@ void CleanHandler::execute(const ParamMap& params,
   std::filesystem::remove("train.block");
   std::filesystem::remove("train.index");
   std::filesystem::remove("seat.memoryriver");
+  std::filesystem::remove("seat.directory");
   std::filesystem::remove("station.block");
   std::filesystem::remove("station.index");
   std::filesystem::remove("route.block");
   std::filesystem::remove("route.index");
-  std::filesystem::remove("pending.block");
-  std::filesystem::remove("pending.index");
-  std::filesystem::remove("user.block");
-  std::filesystem::remove("user.index");
+  std::filesystem::remove("pending.hash");
+  std::filesystem::remove("pending.dir");
+  std::filesystem::remove("users.hash");
+  std::filesystem::remove("users.dir");
   std::cout << '[' << timestamp << "] 0";
 }
+
+CompactHandler::CompactHandler(TrainManager& train_manager,
+                               OrderManager& order_manager)
+    : train_manager(train_manager), order_manager(order_manager) {}
+
+void CompactHandler::execute(const ParamMap& params,
+                             const std::string& timestamp) {
+  // the log refers to pages of the old files, so it is emptied before they
+  // are replaced and the new files are synced before logging resumes
+  WriteAheadLog::instance().checkpoint();
+  // the hash indexes of users and pending orders recycle their own pages
+  train_manager.compact();
+  order_manager.compact();
+  WriteAheadLog::instance().checkpoint();
+  std::cout << '[' << timestamp << "] 0\n";
+}
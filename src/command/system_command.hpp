@@ -1,4 +1,6 @@
 #pragma once
+#include "../controller/order_manager.hpp"
+#include "../controller/train_manager.hpp"
 #include "command_system.hpp"
 
 class ExitHandler : public CommandHandler {
@@ -9,4 +11,14 @@ class ExitHandler : public CommandHandler {
 class CleanHandler : public CommandHandler {
  public:
   void execute(const ParamMap& params, const std::string& timestamp) override;
-};
\ No newline at end of file
+};
+
+class CompactHandler : public CommandHandler {
+ private:
+  TrainManager& train_manager;
+  OrderManager& order_manager;
+
+ public:
+  CompactHandler(TrainManager& train_manager, OrderManager& order_manager);
+  void execute(const ParamMap& params, const std::string& timestamp) override;
+};
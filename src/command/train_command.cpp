@@ -114,8 +114,7 @@ void QueryTrainHandler::execute(const ParamMap& params,
     std::cout << "-1\n";
     return;
   }
-  int pos;
-  SeatMap seat_map = seat_manager.querySeat(train.seat_map_pos, pos,
+  SeatMap seat_map = seat_manager.querySeat(train.seat_map_pos,
                                             date - train.sale_date_start);
   std::cout << format(train, seat_map.seat_num, date) << '\n';
 }
@@ -136,6 +135,8 @@ void QueryTransferHandler::execute(const ParamMap& params,
       train_manager.queryStation(start_station);
   sjtu::vector<FixedString<20>> train_ids_from_end =
       train_manager.queryStation(end_station);
+  train_manager.prefetchTrains(train_ids_from_end);
+  train_manager.prefetchTrains(train_ids_from_start);
   sjtu::vector<Train> trains_to_end;
   for (const auto& train_id : train_ids_from_end) {
     Train train;
@@ -259,10 +260,9 @@ void QueryTransferHandler::execute(const ParamMap& params,
     std::cout << "0\n";
     return;
   }
-  int _pos;
-  SeatMap seat_map1 = seat_manager.querySeat(seat_map_pos_1, _pos,
+  SeatMap seat_map1 = seat_manager.querySeat(seat_map_pos_1,
                                              ticket1.origin_date - sale_date_1);
-  SeatMap seat_map2 = seat_manager.querySeat(seat_map_pos_2, _pos,
+  SeatMap seat_map2 = seat_manager.querySeat(seat_map_pos_2,
                                              ticket2.origin_date - sale_date_2);
   ticket1.seats = seat_map1.queryAvailableSeat(final_start_index,
                                                final_transfer_index_from_start);
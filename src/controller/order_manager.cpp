@@ -2,49 +2,74 @@
 
 #include "../utilities/hash.hpp"
 
-OrderManager::OrderManager() : order_db("order"), pending_db("pending") {}
+OrderManager::OrderManager()
+    : order_heap("order.heap"), order_db("order"), pending_db("pending") {}
 
-void OrderManager::addOrder(const Order& order) {
-  order_db.insert(order.username, order);
+uint64_t OrderManager::addOrder(const Order& order) {
+  uint64_t rid = order_heap.insert(order);
+  order_db.insert(order.username, OrderRef{order.timestamp, rid});
+  return rid;
 }
 
-void OrderManager::addPendingOrder(const Order& order) {
-  long long hashed_key =
+void OrderManager::addPendingOrder(const Order& order, uint64_t rid) {
+  uint64_t hashed_key =
       Hash::hashKey(order.train_id, order.origin_station_date);
-  pending_db.insert(hashed_key, order);
+  pending_db.insert(hashed_key, OrderRef{order.timestamp, rid});
 }
 
 sjtu::vector<Order> OrderManager::queryOrder(const std::string& username) {
-  return order_db.find(username);
+  sjtu::vector<OrderRef> refs = order_db.find(username);
+  sjtu::vector<uint64_t> rids;
+  for (size_t i = 0; i < refs.size(); ++i) {
+    rids.push_back(refs[i].rid);
+  }
+  sjtu::vector<Order> orders;
+  if (refs.empty()) {
+    return orders;
+  }
+  order_heap.prefetch(&rids[0], rids.size());
+  Order order;
+  for (size_t i = 0; i < rids.size(); ++i) {
+    order_heap.read(rids[i], order);
+    orders.push_back(order);
+  }
+  return orders;
 }
 
-void OrderManager::updateOrderStatus(const std::string& username,
-                                     const Order& order, OrderStatus status) {
-  if (status == order.status) {
-    return;
+int OrderManager::queryOrder(const std::string& username, int n,
+                             Order& order, uint64_t& rid) {
+  if (n <= 0) {
+    return -1;
   }
-  Order updated_order = order;
-  updated_order.status = status;
-  order_db.update(username, updated_order, order);
-}
-void OrderManager::updateOrderStatus(const FixedString<20>& username,
-                                     const Order& order, OrderStatus status) {
-  if (status == order.status) {
-    return;
+  // one pass over the user's refs; the n-th newest is n from the end
+  sjtu::vector<uint64_t> rids;
+  order_db.for_each(FixedString<20>(username), [&rids](const OrderRef& ref) {
+    rids.push_back(ref.rid);
+    return true;
+  });
+  if (static_cast<size_t>(n) > rids.size()) {
+    return -1;
   }
-  Order updated_order = order;
-  updated_order.status = status;
-  order_db.update(username, updated_order, order);
+  rid = rids[rids.size() - n];
+  order_heap.read(rid, order);
+  return 0;
+}
+
+void OrderManager::updateOrderStatus(uint64_t rid, OrderStatus status) {
+  Order order;
+  order_heap.read(rid, order);
+  order.status = status;
+  // the status is a single byte of the record, so it stays where it is
+  order_heap.update(rid, order);
 }
 
 void OrderManager::removeFromPending(const FixedString<20>& unitrain,
                                      const Date& date, const Order& order) {
-  long long hashed_key = Hash::hashKey(unitrain, date);
-  pending_db.remove(hashed_key, order);
+  uint64_t hashed_key = Hash::hashKey(unitrain, date);
+  // refs compare by timestamp alone
+  pending_db.remove(hashed_key, OrderRef{order.timestamp, 0});
 }
 
-sjtu::vector<Order> OrderManager::queryPendingOrder(
-    const FixedString<20>& train_id, const Date& date) {
-  long long unitrain = Hash::hashKey(train_id, date);
-  return pending_db.find(unitrain);
-}
\ No newline at end of file
+void OrderManager::compact() {
+  order_db.compact();
+}
@@ -3,23 +3,44 @@
 
 #include "../model/order.hpp"
 #include "../storage/bplus_tree.hpp"
+#include "../storage/extendible_hash.hpp"
+#include "../storage/record_heap.hpp"
+#include "../utilities/hash.hpp"
 #include "../utilities/limited_sized_string.hpp"
 
+// Every order is stored once, in order_heap; both trees map their keys to
+// its record id, so a pending order and its entry in the user's history
+// are the same record.
 class OrderManager {
  private:
-  BPT<FixedString<20>, Order> order_db;  // username -> order
-  BPT<uint64_t, Order> pending_db;       // hashed UniTrain -> pending order
+  RecordHeap<Order> order_heap;
+  BPT<FixedString<20>, OrderRef> order_db;  // username -> order
+  // hashed UniTrain -> pending orders, oldest first
+  ExtendibleHash<uint64_t, OrderRef> pending_db;
  public:
   OrderManager();
-  void addOrder(const Order& order);
-  void addPendingOrder(const Order& order);
-  void updateOrderStatus(const std::string& username, const Order& order,
-                         OrderStatus status);
-  void updateOrderStatus(const FixedString<20>& username, const Order& order,
-                         OrderStatus status);
+  // returns the record id of the order
+  uint64_t addOrder(const Order& order);
+  void addPendingOrder(const Order& order, uint64_t rid);
+  // change the status of the order stored at rid in place
+  void updateOrderStatus(uint64_t rid, OrderStatus status);
   void removeFromPending(const FixedString<20>& train_id, const Date& date,
                          const Order& order);
   sjtu::vector<Order> queryOrder(const std::string& username);
-  sjtu::vector<Order> queryPendingOrder(const FixedString<20>& train_id,
-                                        const Date& date);
+  // the n-th newest order of username, copied into order, and its record id
+  int queryOrder(const std::string& username, int n, Order& order,
+                 uint64_t& rid);
+  // call visit(order, rid) on the pending orders of a train run, oldest
+  // first, until it returns false; pending_db must not change meanwhile
+  template <class Visitor>
+  void queryPendingOrder(const FixedString<20>& train_id, const Date& date,
+                         Visitor visit) {
+    Order order;
+    pending_db.for_each(Hash::hashKey(train_id, date),
+                        [&](const OrderRef& ref) {
+                          order_heap.read(ref.rid, order);
+                          return visit(order, ref.rid);
+                        });
+  }
+  void compact();
 };
@@ -2,44 +2,131 @@
 
 #include "../model/seat.hpp"
 
-SeatManager::SeatManager() : seat_db("seat.memoryriver") {
+SeatManager::SeatManager()
+    : directory_db("seat.directory"),
+      seat_db("seat.memoryriver"),
+      directory_pages(directory_db),
+      seat_pages(seat_db),
+      directory_cache(directory_pages),
+      seat_cache(seat_pages) {
+  if (!directory_db.exist()) {
+    directory_db.initialise();
+  }
   if (!seat_db.exist()) {
     seat_db.initialise();
   }
 }
 
-SeatMap SeatManager::querySeat(int start_pos, int& seat_map_pos,
-                               int date_from_sale_start) {
-  seat_map_pos = start_pos + date_from_sale_start * sizeof(SeatMap);
+SeatMap SeatManager::querySeat(int start_pos, int date_from_sale_start) {
+  const SeatDirectory& directory = directory_cache.get(start_pos);
   SeatMap seat_map;
-  seat_db.read(seat_map, seat_map_pos);
+  seat_map.total_seats = directory.total_seats;
+  seat_map.station_num = directory.station_num;
+  for (int i = 0; i < directory.station_num; ++i) {
+    seat_map.seat_num[i] = directory.total_seats;
+  }
+  SeatLayout layout(directory.total_seats, directory.station_num);
+  int block_pos = directory.blocks[layout.blockOf(date_from_sale_start)];
+  if (block_pos != 0) {
+    layout.load(seat_cache.get(block_pos), date_from_sale_start, seat_map);
+  }
   return seat_map;
 }
 
-int SeatManager::bookSeat(int seat_map_pos, int start_station, int end_station,
-                          int seat, SeatMap& seat_map) {
-  if (seat_map.bookSeat(start_station, end_station, seat)) {
-    seat_db.update(seat_map, seat_map_pos);
-    return 0;
+void SeatManager::querySeats(int start_pos, int first_date_from_sale_start,
+                             int days, sjtu::vector<SeatMap>& seat_maps) {
+  const SeatDirectory& directory = directory_cache.get(start_pos);
+  SeatMap fresh;
+  fresh.total_seats = directory.total_seats;
+  fresh.station_num = directory.station_num;
+  for (int i = 0; i < directory.station_num; ++i) {
+    fresh.seat_num[i] = directory.total_seats;
+  }
+  SeatLayout layout(directory.total_seats, directory.station_num);
+  const SeatBlock* block = nullptr;
+  int block_index = -1;
+  for (int k = 0; k < days; ++k) {
+    int date = first_date_from_sale_start + k;
+    int pos = directory.blocks[layout.blockOf(date)];
+    if (pos == 0) {
+      seat_maps.push_back(fresh);
+      continue;
+    }
+    if (layout.blockOf(date) != block_index) {
+      block = &seat_cache.get(pos);
+      block_index = layout.blockOf(date);
+    }
+    SeatMap seat_map = fresh;
+    layout.load(*block, date, seat_map);
+    seat_maps.push_back(seat_map);
   }
-  return -1;
 }
 
-void SeatManager::initSeat(const Train& train, int& train_seat) {
-  SeatMap seat_map;
-  seat_map.total_seats = train.seat_num;
-  seat_map.station_num = train.station_num;
-  std::fill(seat_map.seat_num, seat_map.seat_num + train.station_num,
-            train.seat_num);
-  train_seat = seat_db.write(seat_map);
-  for (int date = 1; date <= train.sale_date_end - train.sale_date_start;
-       date++) {
-    seat_db.write(seat_map);
+void SeatManager::prefetchSeats(
+    const sjtu::vector<int>& start_pos,
+    const sjtu::vector<int>& dates_from_sale_start) {
+  if (start_pos.empty()) {
+    return;
+  }
+  directory_cache.prefetch(&start_pos[0], start_pos.size());
+  sjtu::vector<int> block_pos;
+  for (size_t i = 0; i < start_pos.size(); ++i) {
+    const SeatDirectory& directory = directory_cache.get(start_pos[i]);
+    SeatLayout layout(directory.total_seats, directory.station_num);
+    int pos = directory.blocks[layout.blockOf(dates_from_sale_start[i])];
+    // consecutive days of a train mostly share their block
+    if (pos != 0 && (block_pos.empty() || block_pos.back() != pos)) {
+      block_pos.push_back(pos);
+    }
+  }
+  if (!block_pos.empty()) {
+    seat_cache.prefetch(&block_pos[0], block_pos.size());
+  }
+}
+
+void SeatManager::store(int start_pos, int date_from_sale_start,
+                        const SeatMap& seat_map) {
+  const SeatDirectory& directory = directory_cache.get(start_pos);
+  SeatLayout layout(directory.total_seats, directory.station_num);
+  int block = layout.blockOf(date_from_sale_start);
+  if (directory.blocks[block] != 0) {
+    layout.store(seat_cache.modify(directory.blocks[block]),
+                 date_from_sale_start, seat_map);
+    return;
   }
+  SeatBlock fresh{};
+  layout.fill(fresh, directory.total_seats);
+  layout.store(fresh, date_from_sale_start, seat_map);
+  SeatDirectory linked = directory;
+  linked.blocks[block] = seat_pages.write(fresh);
+  directory_cache.put(linked, start_pos);
+}
+
+int SeatManager::bookSeat(int start_pos, int date_from_sale_start,
+                          int start_station, int end_station, int seat,
+                          SeatMap& seat_map) {
+  if (!seat_map.bookSeat(start_station, end_station, seat)) {
+    return -1;
+  }
+  store(start_pos, date_from_sale_start, seat_map);
+  return 0;
+}
+
+void SeatManager::initSeat(const Train& train, int& train_seat) {
+  SeatDirectory directory{};
+  directory.total_seats = train.seat_num;
+  directory.station_num = train.station_num;
+  train_seat = directory_pages.write(directory);
 }
 
-void SeatManager::releaseSeat(int seat_map_pos, int start_station,
-                              int end_station, int seat, SeatMap& seat_map) {
+void SeatManager::releaseSeat(int start_pos, int date_from_sale_start,
+                              int start_station, int end_station, int seat,
+                              SeatMap& seat_map) {
   seat_map.releaseSeat(start_station, end_station, seat);
-  seat_db.update(seat_map, seat_map_pos);
-}
\ No newline at end of file
+  store(start_pos, date_from_sale_start, seat_map);
+}
+
+void SeatManager::writeBack() {
+  directory_cache.writeBack();
+  seat_cache.writeBack();
+}
@@ -2,19 +2,53 @@
 
 #include "../model/seat.hpp"
 #include "../model/train.hpp"
-#include "../storage/memory_river.hpp"
+#include "../storage/cache.hpp"
+#include "../storage/record_cache.hpp"
+#include "../storage/river.hpp"
 
+// A train's seats are found through its SeatDirectory, at the train's
+// seat_map_pos. Releasing a train only writes the directory; a block of
+// days is written on the first booking of one of them. Callers see whole
+// SeatMaps, which are unpacked from and packed into the narrow rows of
+// the blocks.
 class SeatManager {
  private:
-  MemoryRiver<SeatMap> seat_db;
+  using BlockRiver = River<SeatBlock, 2, CACHE_LINE_SIZE>;
+
+  River<SeatDirectory> directory_db;
+  BlockRiver seat_db;
+  // seats are read and written through the shared buffer pool
+  sjtu::PagedFile<SeatDirectory> directory_pages;
+  sjtu::PagedFile<SeatBlock, 2, CACHE_LINE_SIZE> seat_pages;
+  // the directories and seat blocks of hot trains stay here, booked and
+  // released in place, and reach the pool once per command
+  RecordCache<SeatDirectory> directory_cache;
+  RecordCache<SeatBlock, 2, CACHE_LINE_SIZE> seat_cache;
+
+  // keep seat_map as the day's seats, writing its block and linking it
+  // from the directory if it is the block's first change
+  void store(int start_pos, int date_from_sale_start, const SeatMap& seat_map);
 
  public:
   SeatManager();
   void initSeat(const Train& train, int& train_seat);
-  SeatMap querySeat(int start_pos, int& seat_map_pos, int date_from_sale_start);
-  int bookSeat(int seat_map_pos, int start_station, int end_station, int seat,
-               SeatMap& seat_map);
+  SeatMap querySeat(int start_pos, int date_from_sale_start);
+  // append the seat maps of days consecutive days from the first one,
+  // reading each block of them once
+  void querySeats(int start_pos, int first_date_from_sale_start, int days,
+                  sjtu::vector<SeatMap>& seat_maps);
+  // load the seat maps querySeat(start_pos[i], dates[i]) will read in one
+  // batch
+  void prefetchSeats(const sjtu::vector<int>& start_pos,
+                     const sjtu::vector<int>& dates_from_sale_start);
+  // seat_map is what querySeat returned for the same day
+  int bookSeat(int start_pos, int date_from_sale_start, int start_station,
+               int end_station, int seat, SeatMap& seat_map);
+
+  void releaseSeat(int start_pos, int date_from_sale_start, int start_station,
+                   int end_station, int seat, SeatMap& seat_map);
 
-  void releaseSeat(int seat_map_pos, int start_station, int end_station,
-                   int seat, SeatMap& seat_map);
+  // hand the seats changed since the last call to the buffer pool,
+  // before the running command is committed
+  void writeBack();
 };
\ No newline at end of file
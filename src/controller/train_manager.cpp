@@ -1,70 +1,74 @@
 #include "train_manager.hpp"
 
 TrainManager::TrainManager()
-    : train_db("train"), station_db("station"), route_db("route") {}
+    : train_db("train", true), station_db("station"), route_db("route") {
+  train_db.deferMerges(true);
+}
 int TrainManager::addTrain(const Train& train) {
-  if (train_db.exists(train.train_id)) {
+  if (!train_db.put(train.train_id, train)) {
     return -1;
   }
-  train_db.insert(train.train_id, train);
   return 0;
 }
 
 int TrainManager::deleteTrain(const std::string& train_id) {
-  sjtu::vector<Train> result = train_db.find(train_id);
-  if (result.empty() || result[0].is_released) {
+  FixedString<20> key(train_id);
+  Train train;
+  if (!train_db.get(key, train) || train.is_released) {
     return -1;
   }
-  train_db.remove(train_id, result[0]);
+  train_db.erase(key);
   return 0;
 }
 
 int TrainManager::releaseTrain(const std::string& train_id, Train& train) {
-  sjtu::vector<Train> result = train_db.find(train_id);
-  if (result.empty() || result[0].is_released) {
+  if (!train_db.get(train_id, train) || train.is_released) {
     return -1;
   }
-  train = std::move(result[0]);
+  sjtu::vector<Key_Value<uint64_t, FixedString<20>>> stations(
+      train.station_num);
   for (size_t i = 0; i < train.station_num; ++i) {
-    station_db.insert(train.stations[i], train.train_id);
+    stations.push_back({Hash::hashKey<30>(train.stations[i]), train.train_id});
   }
+  station_db.insertBatch(stations);
+  sjtu::vector<Key_Value<uint64_t, FixedString<20>>> routes(
+      train.station_num * (train.station_num - 1) / 2);
   for (size_t i = 0; i < train.station_num - 1; ++i) {
     for (size_t j = i + 1; j < train.station_num; ++j) {
-      Route route{train.stations[i], train.stations[j]};
-      route_db.insert(route, train.train_id);
+      routes.push_back({Hash::hashKey(train.stations[i], train.stations[j]),
+                        train.train_id});
     }
   }
+  route_db.insertBatch(routes);
   return 0;
 }
 
 int TrainManager::queryTrain(const std::string& train_id, Train& train) {
-  sjtu::vector<Train> result = train_db.find(train_id);
-  if (result.empty()) {
+  if (!train_db.get(train_id, train)) {
     return -1;
   }
-  train = result[0];
   return 0;
 }
 
 int TrainManager::queryTrain(const FixedString<20>& train_id, Train& train) {
-  sjtu::vector<Train> result = train_db.find(train_id);
-  if (result.empty()) {
+  if (!train_db.get(train_id, train)) {
     return -1;
   }
-  train = std::move(result[0]);
   return 0;
 }
 
 sjtu::vector<FixedString<20>> TrainManager::queryStation(
     const std::string& station_id) {
-  return station_db.find(station_id);
+  return queryStation(FixedString<30>(station_id));
 }
 
 sjtu::vector<FixedString<20>> TrainManager::queryStation(
     const FixedString<30>& station_id) {
-  return station_db.find(station_id);
+  return station_db.find(Hash::hashKey<30>(station_id));
 }
 
-sjtu::vector<FixedString<20>> TrainManager::queryRoute(const Route& route) {
-  return route_db.find(route);
+void TrainManager::compact() {
+  train_db.compact();
+  station_db.compact();
+  route_db.compact();
 }
\ No newline at end of file
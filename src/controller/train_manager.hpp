@@ -2,13 +2,17 @@
 
 #include "../model/train.hpp"
 #include "../storage/bplus_tree.hpp"
+#include "../storage/unique_bplus_tree.hpp"
+#include "../utilities/hash.hpp"
 
 class TrainManager {
  private:
-  BPT<FixedString<20>, Train> train_db;
-  BPT<FixedString<30>, FixedString<20>>
-      station_db;                        // Maps station to train IDs
-  BPT<Route, FixedString<20>> route_db;  // Maps route to train IDs
+  UniqueBPT<FixedString<20>, Train> train_db;
+  // Both are only looked up by exact key, so they are keyed by hash, which
+  // keeps leaf entries at 40 bytes. A colliding station or route only adds
+  // trains that the callers reject when they look the stations up.
+  BPT<uint64_t, FixedString<20>> station_db;  // hashed station -> train IDs
+  BPT<uint64_t, FixedString<20>> route_db;    // hashed route -> train IDs
  public:
   TrainManager();
 
@@ -22,6 +26,13 @@ class TrainManager {
 
   int queryTrain(const FixedString<20>& train_id, Train& train);
 
+  // load the trains about to be queried in batches, see UniqueBPT::prefetch
+  void prefetchTrains(const sjtu::vector<FixedString<20>>& train_ids) {
+    if (!train_ids.empty()) {
+      train_db.prefetch(&train_ids[0], train_ids.size());
+    }
+  }
+
   void updateTrain(const Train& train) {
     train_db.update(train.train_id, train);
   }
@@ -30,5 +41,12 @@ class TrainManager {
 
   sjtu::vector<FixedString<20>> queryStation(const FixedString<30>& station_id);
 
-  sjtu::vector<FixedString<20>> queryRoute(const Route& route);
+  // call visit(train_id) on the trains running along route until it returns
+  // false; route_db must not change meanwhile
+  template <class Visitor>
+  void queryRoute(const Route& route, Visitor visit) {
+    route_db.for_each(Hash::hashKey(route.from, route.to), visit);
+  }
+
+  void compact();
 };
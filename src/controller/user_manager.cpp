@@ -16,11 +16,11 @@ int UserManager::addUser(const std::string& cur_username,
   uint64_t username_hash = Hash::hashKey(username);
   if (is_first_user) {
     User user(username, password, name, mail_addr, 10);
-    user_db.insert(username_hash, user);
+    user_db.put(username_hash, user);
     is_first_user = false;
     return 0;
   }
-  if (user_db.exists(username_hash)) {
+  if (user_db.contains(username_hash)) {
     return -1;
   }
   auto iter = logged_in_users.find(cur_username);
@@ -32,7 +32,7 @@ int UserManager::addUser(const std::string& cur_username,
     return -1;
   }
   User user(username, password, name, mail_addr, privilege);
-  user_db.insert(username_hash, user);
+  user_db.put(username_hash, user);
   return 0;
 }
 
@@ -42,14 +42,14 @@ int UserManager::login(const std::string& username,
     return -1;
   }
   uint64_t username_hash = Hash::hashKey(username);
-  sjtu::vector<User> result = user_db.find(username_hash);
-  if (result.empty()) {
+  User user;
+  if (!user_db.get(username_hash, user)) {
     return -1;
   }
-  if (result[0].password.comparedToString(password) != 0) {
+  if (user.password.comparedToString(password) != 0) {
     return -1;
   }
-  logged_in_users[username] = result[0].privilege;
+  logged_in_users[username] = user.privilege;
   return 0;
 }
 
@@ -69,17 +69,17 @@ sjtu::pair<int, UserProfile> UserManager::queryProfile(
     return sjtu::pair(-1, UserProfile());
   }
   int cur_privilege = iter->second;
-  sjtu::vector<User> result = user_db.find(Hash::hashKey(username));
-  if (result.empty()) {
+  User user;
+  if (!user_db.get(Hash::hashKey(username), user)) {
     return sjtu::pair(-1, UserProfile());
   }
-  if (cur_privilege < result[0].privilege ||
-      (cur_privilege == result[0].privilege && cur_username != username)) {
+  if (cur_privilege < user.privilege ||
+      (cur_privilege == user.privilege && cur_username != username)) {
     return sjtu::pair(-1, UserProfile());
   }
   return sjtu::pair(
-      0, UserProfile{result[0].username.toString(), result[0].name.toString(),
-                     result[0].mail_addr.toString(), result[0].privilege});
+      0, UserProfile{user.username.toString(), user.name.toString(),
+                     user.mail_addr.toString(), user.privilege});
 }
 
 sjtu::pair<int, UserProfile> UserManager::modifyProfile(
@@ -95,11 +95,10 @@ sjtu::pair<int, UserProfile> UserManager::modifyProfile(
     return sjtu::pair{-1, UserProfile()};
   }
   uint64_t username_hash = Hash::hashKey(username);
-  sjtu::vector<User> result = user_db.find(username_hash);
-  if (result.empty()) {
+  User user;
+  if (!user_db.get(username_hash, user)) {
     return sjtu::pair{-1, UserProfile()};
   }
-  User& user = result[0];
   if (cur_privilege < user.privilege ||
       (cur_privilege == user.privilege && cur_username != username)) {
     return sjtu::pair{-1, UserProfile()};
@@ -119,7 +118,6 @@ sjtu::pair<int, UserProfile> UserManager::modifyProfile(
       logged_in_users[cur_username] = privilege;
     }
   }
-  // need further optimization
   user_db.update(username_hash, user);
 
   return sjtu::pair{0, UserProfile{username, user.name.toString(),
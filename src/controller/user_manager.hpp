@@ -4,11 +4,12 @@
 #include "../model/user.hpp"
 #include "../stl/map.hpp"
 #include "../stl/utility.hpp"
-#include "../storage/bplus_tree.hpp"
+#include "../storage/extendible_hash.hpp"
 
 class UserManager {
  private:
-  BPT<uint64_t, User> user_db;
+  // users are only ever looked up by the hash of their name
+  ExtendibleHash<uint64_t, User> user_db;
 
   sjtu::map<std::string, int> logged_in_users{};  // from username to privilege
 
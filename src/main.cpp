@@ -8,8 +8,14 @@
 #include "command/system_command.hpp"
 #include "command/train_command.hpp"
 #include "command/user_command.hpp"
+#include "storage/wal.hpp"
 
 int main() {
+  // cin buffers on its own, so in_avail tells whether a command is ready
+  std::ios::sync_with_stdio(false);
+  // bring the data files up to the last committed command before any of
+  // them is opened
+  WriteAheadLog::instance().recover();
   CommandSystem command_system;
   UserManager user_manager;
   TrainManager train_manager;
@@ -33,6 +39,9 @@ int main() {
       "query_train", new QueryTrainHandler(train_manager, seat_manager));
   command_system.registerHandler(
       "query_ticket", new QueryTicketHandler(train_manager, seat_manager));
+  command_system.registerHandler(
+      "query_ticket_range",
+      new QueryTicketRangeHandler(train_manager, seat_manager));
   command_system.registerHandler(
       "buy_ticket", new BuyTicketHandler(train_manager, seat_manager,
                                          user_manager, order_manager));
@@ -45,12 +54,24 @@ int main() {
 
   command_system.registerHandler(
       "query_transfer", new QueryTransferHandler(train_manager, seat_manager));
+  command_system.registerHandler(
+      "compact", new CompactHandler(train_manager, order_manager));
   std::string line;
 
-  while (getline(std::cin, line)) {
+  while (true) {
+    if (std::cin.rdbuf()->in_avail() <= 0) {
+      // the answers so far must be out before waiting on the next command
+      std::cout.flush();
+      WriteAheadLog::instance().awaitInput(0);
+    }
+    if (!getline(std::cin, line)) {
+      break;
+    }
     std::string timestamp;
     std::string cmd_name;
     command_system.parseAndExecute(line, timestamp, cmd_name);
+    seat_manager.writeBack();
+    WriteAheadLog::instance().commit();
     if (cmd_name == "exit") {
       break;
     }
@@ -1,4 +1,5 @@
 #pragma once
+#include "../storage/separator_traits.hpp"
 #include "../utilities/limited_sized_string.hpp"
 #include "time.hpp"
 
@@ -99,3 +100,42 @@ struct Order {
     return result;
   }
 };
+
+// Where an order is kept in the order heap. The trees of OrderManager hold
+// these instead of whole orders, ordered by timestamp like the orders.
+struct OrderRef {
+  int timestamp{};
+  uint64_t rid{};
+
+  bool operator<(const OrderRef& other) const {
+    return timestamp < other.timestamp;
+  }
+  bool operator>(const OrderRef& other) const {
+    return timestamp > other.timestamp;
+  }
+  bool operator==(const OrderRef& other) const {
+    return timestamp == other.timestamp;
+  }
+  bool operator!=(const OrderRef& other) const {
+    return timestamp != other.timestamp;
+  }
+  bool operator<=(const OrderRef& other) const {
+    return timestamp <= other.timestamp;
+  }
+  bool operator>=(const OrderRef& other) const {
+    return timestamp >= other.timestamp;
+  }
+};
+
+// orders are compared by their timestamp
+template <>
+struct SeparatorTraits<Order> {
+  using Tie = int;
+  static Tie tie(const Order& order) { return order.timestamp; }
+};
+
+template <>
+struct SeparatorTraits<OrderRef> {
+  using Tie = int;
+  static Tie tie(const OrderRef& ref) { return ref.timestamp; }
+};
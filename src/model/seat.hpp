@@ -1,4 +1,8 @@
 #pragma once
+#include <cstdint>
+#include <cstring>
+
+#include "seat_kernels.hpp"
 #include "train.hpp"
 
 struct SeatMap {
@@ -7,38 +11,19 @@ struct SeatMap {
   int seat_num[MAX_STATION_NUM];
 
   int queryAvailableSeat(int start_station, int end_station) {
-    int min_seat = seat_num[start_station];
-    for (int i = start_station + 1; i < end_station; i++) {
-      if (seat_num[i] < min_seat) {
-        min_seat = seat_num[i];
-      }
-    }
-    return min_seat;
+    return seatRangeMin(seat_num, start_station, end_station);
   }
 
   bool isSeatAvailable(int start_station, int end_station, int seat) {
-    for (int i = start_station; i < end_station; i++) {
-      if (seat_num[i] < seat) {
-        return false;
-      }
-    }
-    return true;
+    return seatRangeMin(seat_num, start_station, end_station) >= seat;
   }
 
   bool bookSeat(int start_station, int end_station, int seat) {
-    if (!isSeatAvailable(start_station, end_station, seat)) {
-      return false;
-    }
-    for (int i = start_station; i < end_station; i++) {
-      seat_num[i] -= seat;
-    }
-    return true;
+    return seatTryBook(seat_num, start_station, end_station, seat);
   }
 
   void releaseSeat(int start_station, int end_station, int seat) {
-    for (int i = start_station; i < end_station; i++) {
-      seat_num[i] += seat;
-    }
+    seatRangeAdd(seat_num, start_station, end_station, seat);
   }
 
   bool operator==(const SeatMap& other) const {
@@ -58,4 +43,104 @@ struct SeatMap {
   bool operator>=(const SeatMap& other) const {
     return total_seats >= other.total_seats;
   }
-};
\ No newline at end of file
+};
+
+// sale dates lie within June to August
+constexpr int MAX_SALE_DAYS = 92;
+
+// Seat counters of consecutive sale days of one train, one row per day.
+// A row holds the station_num - 1 segments only, in 16-bit counters unless
+// the train has more seats than that. Rows are padded to a power of two
+// up to a cache line, so that a row never straddles one, and blocks are
+// four cache lines.
+constexpr int SEAT_BLOCK_SIZE = 256;
+constexpr int CACHE_LINE_SIZE = 64;
+
+struct SeatBlock {
+  unsigned char bytes[SEAT_BLOCK_SIZE];
+};
+
+// the widest row, 32-bit counters of a full train, still leaves two days
+constexpr int MAX_SEAT_BLOCKS = (MAX_SALE_DAYS + 1) / 2;
+
+struct SeatLayout {
+  int width;
+  int segments;
+  int row_size;
+  int days_per_block;
+
+  SeatLayout(int total_seats, int station_num)
+      : width(total_seats <= 0xFFFF ? 2 : 4),
+        segments(station_num - 1),
+        row_size(width) {
+    while (row_size < segments * width) {
+      row_size *= 2;
+    }
+    if (row_size > CACHE_LINE_SIZE) {
+      row_size = (segments * width + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE *
+                 CACHE_LINE_SIZE;
+    }
+    days_per_block = SEAT_BLOCK_SIZE / row_size;
+  }
+
+  int blockOf(int day) const { return day / days_per_block; }
+
+  // a block in which every segment of every day has seats left
+  void fill(SeatBlock& block, int seats) const {
+    for (int day = 0; day < days_per_block; ++day) {
+      for (int i = 0; i < segments; ++i) {
+        put(block, day, i, seats);
+      }
+    }
+  }
+
+  void load(const SeatBlock& block, int day, SeatMap& seat_map) const {
+    for (int i = 0; i < segments; ++i) {
+      seat_map.seat_num[i] = get(block, day, i);
+    }
+  }
+
+  void store(SeatBlock& block, int day, const SeatMap& seat_map) const {
+    for (int i = 0; i < segments; ++i) {
+      put(block, day, i, seat_map.seat_num[i]);
+    }
+  }
+
+ private:
+  unsigned char* at(SeatBlock& block, int day, int segment) const {
+    return block.bytes + day % days_per_block * row_size + segment * width;
+  }
+  const unsigned char* at(const SeatBlock& block, int day,
+                          int segment) const {
+    return block.bytes + day % days_per_block * row_size + segment * width;
+  }
+
+  int get(const SeatBlock& block, int day, int segment) const {
+    if (width == 2) {
+      uint16_t seats;
+      memcpy(&seats, at(block, day, segment), 2);
+      return seats;
+    }
+    int seats;
+    memcpy(&seats, at(block, day, segment), 4);
+    return seats;
+  }
+
+  void put(SeatBlock& block, int day, int segment, int seats) const {
+    if (width == 2) {
+      uint16_t narrow = seats;
+      memcpy(at(block, day, segment), &narrow, 2);
+    } else {
+      memcpy(at(block, day, segment), &seats, 4);
+    }
+  }
+};
+
+// Seats of one released train. A block is only written once a ticket of
+// one of its days is booked; until then blocks[block] is 0 and every
+// segment of its days has total_seats seats left.
+struct SeatDirectory {
+  int total_seats;
+  int station_num;
+  int blocks[MAX_SEAT_BLOCKS];
+};
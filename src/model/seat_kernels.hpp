@@ -0,0 +1,235 @@
+#pragma once
+#include <climits>
+
+#include "train.hpp"
+
+// Kernels over the seat counters of the segments [start, end) of a seat
+// map. The vector versions are picked at build time: AVX2 when the
+// compiler targets it (CMake option SEAT_KERNELS_AVX2), else SSE2, which
+// every x86-64 target has. -DSEAT_SIMD=0 keeps the scalar loops.
+#ifndef SEAT_SIMD
+#define SEAT_SIMD 1
+#endif
+
+#if SEAT_SIMD && defined(__AVX2__)
+#define SEAT_KERNELS_AVX2 1
+#include <immintrin.h>
+#elif SEAT_SIMD && defined(__SSE2__)
+#define SEAT_KERNELS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// reference loops, also what the benchmark compares the vectors against
+inline int seatRangeMinScalar(const int* seats, int start, int end) {
+  int min_seat = INT_MAX;
+  for (int i = start; i < end; i++) {
+    if (seats[i] < min_seat) {
+      min_seat = seats[i];
+    }
+  }
+  return min_seat;
+}
+
+inline void seatRangeAddScalar(int* seats, int start, int end, int delta) {
+  for (int i = start; i < end; i++) {
+    seats[i] += delta;
+  }
+}
+
+inline bool seatTryBookScalar(int* seats, int start, int end, int seat) {
+  for (int i = start; i < end; i++) {
+    if (seats[i] < seat) {
+      return false;
+    }
+  }
+  seatRangeAddScalar(seats, start, end, -seat);
+  return true;
+}
+
+#if SEAT_KERNELS_AVX2
+
+constexpr int SEAT_LANES = 8;
+constexpr int SEAT_CHUNKS = (MAX_STATION_NUM + SEAT_LANES - 1) / SEAT_LANES;
+
+// lanes of the chunk at from that lie before end; masked loads and stores
+// leave the other lanes alone, so a chunk may run past the counters
+inline __m256i seatMask(int from, int end) {
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  return _mm256_cmpgt_epi32(_mm256_set1_epi32(end - from), lanes);
+}
+
+inline int seatMin(__m256i v) {
+  __m128i m = _mm_min_epi32(_mm256_castsi256_si128(v),
+                            _mm256_extracti128_si256(v, 1));
+  m = _mm_min_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+  m = _mm_min_epi32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(m);
+}
+
+// counters of [start, end) with INT_MAX in the lanes outside it
+inline __m256i seatLoad(const int* seats, int from, __m256i mask) {
+  __m256i v = _mm256_maskload_epi32(seats + from, mask);
+  return _mm256_or_si256(
+      v, _mm256_andnot_si256(mask, _mm256_set1_epi32(INT_MAX)));
+}
+
+inline int seatRangeMin(const int* seats, int start, int end) {
+  __m256i min = _mm256_set1_epi32(INT_MAX);
+  for (int i = start; i < end; i += SEAT_LANES) {
+    min = _mm256_min_epi32(min, seatLoad(seats, i, seatMask(i, end)));
+  }
+  return seatMin(min);
+}
+
+inline void seatRangeAdd(int* seats, int start, int end, int delta) {
+  const __m256i add = _mm256_set1_epi32(delta);
+  for (int i = start; i < end; i += SEAT_LANES) {
+    __m256i mask = seatMask(i, end);
+    __m256i v = _mm256_maskload_epi32(seats + i, mask);
+    _mm256_maskstore_epi32(seats + i, mask, _mm256_add_epi32(v, add));
+  }
+}
+
+// check and book in one pass: the chunks stay in registers between the
+// check and the stores
+inline bool seatTryBook(int* seats, int start, int end, int seat) {
+  __m256i chunks[SEAT_CHUNKS];
+  __m256i masks[SEAT_CHUNKS];
+  __m256i min = _mm256_set1_epi32(INT_MAX);
+  int n = 0;
+  for (int i = start; i < end; i += SEAT_LANES, ++n) {
+    masks[n] = seatMask(i, end);
+    chunks[n] = _mm256_maskload_epi32(seats + i, masks[n]);
+    min = _mm256_min_epi32(
+        min, _mm256_or_si256(chunks[n], _mm256_andnot_si256(
+                                            masks[n],
+                                            _mm256_set1_epi32(INT_MAX))));
+  }
+  if (seatMin(min) < seat) {
+    return false;
+  }
+  const __m256i sub = _mm256_set1_epi32(seat);
+  for (int k = 0; k < n; ++k) {
+    _mm256_maskstore_epi32(seats + start + k * SEAT_LANES, masks[k],
+                           _mm256_sub_epi32(chunks[k], sub));
+  }
+  return true;
+}
+
+inline const char* seatKernelName() { return "avx2"; }
+
+#elif SEAT_KERNELS_SSE2
+
+constexpr int SEAT_LANES = 4;
+constexpr int SEAT_CHUNKS = (MAX_STATION_NUM + SEAT_LANES - 1) / SEAT_LANES;
+
+// SSE2 has neither masked loads nor a 32-bit min, so a chunk is only
+// loaded when it lies inside the counters and the last few counters of a
+// full map are done by the scalar loops; lanes past end are masked off
+inline bool seatChunkFits(int from) {
+  return from + SEAT_LANES <= MAX_STATION_NUM;
+}
+
+inline __m128i seatMask(int from, int end) {
+  return _mm_cmpgt_epi32(_mm_set1_epi32(end - from),
+                         _mm_setr_epi32(0, 1, 2, 3));
+}
+
+inline __m128i seatMin(__m128i a, __m128i b) {
+  __m128i a_greater = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(a_greater, b),
+                      _mm_andnot_si128(a_greater, a));
+}
+
+inline int seatMin(__m128i m) {
+  m = seatMin(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+  m = seatMin(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(m);
+}
+
+inline __m128i seatLoad(const int* seats, int from, __m128i mask) {
+  __m128i v =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(seats + from));
+  return _mm_or_si128(_mm_and_si128(mask, v),
+                      _mm_andnot_si128(mask, _mm_set1_epi32(INT_MAX)));
+}
+
+inline int seatRangeMin(const int* seats, int start, int end) {
+  __m128i min = _mm_set1_epi32(INT_MAX);
+  int i = start;
+  for (; i < end && seatChunkFits(i); i += SEAT_LANES) {
+    min = seatMin(min, seatLoad(seats, i, seatMask(i, end)));
+  }
+  int result = seatMin(min);
+  for (; i < end; ++i) {
+    if (seats[i] < result) {
+      result = seats[i];
+    }
+  }
+  return result;
+}
+
+inline void seatRangeAdd(int* seats, int start, int end, int delta) {
+  int i = start;
+  for (; i < end && seatChunkFits(i); i += SEAT_LANES) {
+    __m128i* p = reinterpret_cast<__m128i*>(seats + i);
+    __m128i add = _mm_and_si128(seatMask(i, end), _mm_set1_epi32(delta));
+    _mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), add));
+  }
+  seatRangeAddScalar(seats, i, end, delta);
+}
+
+// check and book in one pass: the chunks stay in registers between the
+// check and the stores
+inline bool seatTryBook(int* seats, int start, int end, int seat) {
+  __m128i chunks[SEAT_CHUNKS];
+  __m128i masks[SEAT_CHUNKS];
+  __m128i min = _mm_set1_epi32(INT_MAX);
+  int n = 0;
+  int i = start;
+  for (; i < end && seatChunkFits(i); i += SEAT_LANES, ++n) {
+    masks[n] = seatMask(i, end);
+    chunks[n] =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(seats + i));
+    min = seatMin(min, _mm_or_si128(_mm_and_si128(masks[n], chunks[n]),
+                                    _mm_andnot_si128(
+                                        masks[n], _mm_set1_epi32(INT_MAX))));
+  }
+  int tail = i;
+  if (seatMin(min) < seat) {
+    return false;
+  }
+  for (; i < end; ++i) {
+    if (seats[i] < seat) {
+      return false;
+    }
+  }
+  const __m128i sub = _mm_set1_epi32(seat);
+  for (int k = 0; k < n; ++k) {
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(seats + start + k * SEAT_LANES),
+        _mm_sub_epi32(chunks[k], _mm_and_si128(masks[k], sub)));
+  }
+  seatRangeAddScalar(seats, tail, end, -seat);
+  return true;
+}
+
+inline const char* seatKernelName() { return "sse2"; }
+
+#else
+
+inline int seatRangeMin(const int* seats, int start, int end) {
+  return seatRangeMinScalar(seats, start, end);
+}
+
+inline void seatRangeAdd(int* seats, int start, int end, int delta) {
+  seatRangeAddScalar(seats, start, end, delta);
+}
+
+inline bool seatTryBook(int* seats, int start, int end, int seat) {
+  return seatTryBookScalar(seats, start, end, seat);
+}
+
+inline const char* seatKernelName() { return "scalar"; }
+
+#endif
@@ -90,22 +90,17 @@ struct Route {
   FixedString<30> from{};
   FixedString<30> to{};
 
-  bool operator<(const Route& other) const {
-    if (from != other.from) return from < other.from;
-    return to < other.to;
-  }
-  bool operator>(const Route& other) const {
-    if (from != other.from) return from > other.from;
-    return to > other.to;
+  int compare(const Route& other) const {
+    int cmp = from.compare(other.from);
+    return cmp != 0 ? cmp : to.compare(other.to);
   }
+
+  bool operator<(const Route& other) const { return compare(other) < 0; }
+  bool operator>(const Route& other) const { return compare(other) > 0; }
   bool operator==(const Route& other) const {
     return from == other.from && to == other.to;
   }
   bool operator!=(const Route& other) const { return !(*this == other); }
-  bool operator<=(const Route& other) const {
-    return *this < other || *this == other;
-  }
-  bool operator>=(const Route& other) const {
-    return *this > other || *this == other;
-  }
+  bool operator<=(const Route& other) const { return compare(other) <= 0; }
+  bool operator>=(const Route& other) const { return compare(other) >= 0; }
 };
@@ -0,0 +1,90 @@
+#include "bloom_filter.hpp"
+
+#include <cstring>
+#include <fstream>
+
+BloomFilter::BloomFilter(const std::string& file_name)
+    : file_name_(file_name) {}
+
+BloomFilter::~BloomFilter() { delete[] bits_; }
+
+bool BloomFilter::load() {
+  std::ifstream file(file_name_, std::ios::binary);
+  Header header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(Header)) ||
+      header.clean != 1 || header.hashes != BLOOM_HASHES ||
+      header.words == 0) {
+    return false;
+  }
+  uint64_t* bits = new uint64_t[header.words];
+  if (!file.read(reinterpret_cast<char*>(bits),
+                 header.words * sizeof(uint64_t))) {
+    delete[] bits;
+    return false;
+  }
+  file.close();
+  delete[] bits_;
+  bits_ = bits;
+  words_ = header.words;
+  capacity_ = header.capacity;
+  count_ = header.count;
+  // until the next save the file no longer matches the filter
+  writeHeader(false);
+  return true;
+}
+
+void BloomFilter::save() {
+  if (bits_ == nullptr) {
+    return;
+  }
+  {
+    std::ofstream file(file_name_, std::ios::binary | std::ios::trunc);
+    Header header{0, BLOOM_HASHES, capacity_, count_, words_};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    file.write(reinterpret_cast<const char*>(bits_),
+               words_ * sizeof(uint64_t));
+  }
+  // the clean mark goes last, so a torn save is never trusted
+  writeHeader(true);
+}
+
+void BloomFilter::writeHeader(bool clean) {
+  std::fstream file(file_name_,
+                    std::ios::in | std::ios::out | std::ios::binary);
+  Header header{clean ? 1 : 0, BLOOM_HASHES, capacity_, count_, words_};
+  file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+}
+
+void BloomFilter::reset(size_t capacity) {
+  delete[] bits_;
+  capacity_ = capacity;
+  count_ = 0;
+  words_ = (capacity * BLOOM_BITS_PER_KEY + 63) / 64;
+  bits_ = new uint64_t[words_];
+  memset(bits_, 0, words_ * sizeof(uint64_t));
+}
+
+// probe i is at h1 + i * h2, see Kirsch and Mitzenmacher
+void BloomFilter::add(uint64_t hash) {
+  uint64_t bits = words_ * 64;
+  uint64_t h2 = (hash >> 32) | 1;
+  for (int i = 0; i < BLOOM_HASHES; ++i) {
+    uint64_t bit = (hash + i * h2) % bits;
+    bits_[bit / 64] |= 1ULL << (bit % 64);
+  }
+  count_++;
+}
+
+bool BloomFilter::mayContain(uint64_t hash) {
+  queries_++;
+  uint64_t bits = words_ * 64;
+  uint64_t h2 = (hash >> 32) | 1;
+  for (int i = 0; i < BLOOM_HASHES; ++i) {
+    uint64_t bit = (hash + i * h2) % bits;
+    if ((bits_[bit / 64] & (1ULL << (bit % 64))) == 0) {
+      negatives_++;
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,92 @@
+#ifndef BPT_BLOOM_FILTER_HPP
+#define BPT_BLOOM_FILTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "../utilities/hash.hpp"
+#include "../utilities/limited_sized_string.hpp"
+
+// Filter size per key and probes per lookup, about 1% false positives.
+#ifndef BLOOM_BITS_PER_KEY
+#define BLOOM_BITS_PER_KEY 10
+#endif
+#ifndef BLOOM_HASHES
+#define BLOOM_HASHES 7
+#endif
+// Smallest number of keys a filter is sized for.
+#ifndef BLOOM_MIN_KEYS
+#define BLOOM_MIN_KEYS 1024
+#endif
+
+// Bloom filter over the keys of one tree. It lives in memory and is saved
+// to its own file on clean shutdown. Loading marks the file unclean, so
+// after a crash load() fails and the owner rebuilds the filter from its
+// keys. Erased keys stay in the filter until the next rebuild.
+class BloomFilter {
+ public:
+  explicit BloomFilter(const std::string& file_name);
+  ~BloomFilter();
+
+  BloomFilter(const BloomFilter&) = delete;
+  BloomFilter& operator=(const BloomFilter&) = delete;
+
+  // false if the file is missing or was not closed cleanly
+  bool load();
+  void save();
+  // drop every key and make room for capacity of them
+  void reset(size_t capacity);
+
+  void add(uint64_t hash);
+  // false means the key was never added
+  bool mayContain(uint64_t hash);
+  // the filter said maybe, but the key was absent
+  void recordFalsePositive() { false_positives_++; }
+
+  // more keys were added than the filter was sized for
+  bool full() const { return count_ > capacity_; }
+  size_t count() const { return count_; }
+
+  size_t queries() const { return queries_; }
+  size_t negatives() const { return negatives_; }
+  size_t falsePositives() const { return false_positives_; }
+
+ private:
+  struct Header {
+    int clean;
+    int hashes;
+    size_t capacity;
+    size_t count;
+    size_t words;
+  };
+
+  std::string file_name_;
+  uint64_t* bits_{nullptr};
+  size_t words_{0};
+  size_t capacity_{0};
+  size_t count_{0};
+
+  size_t queries_{0};
+  size_t negatives_{0};
+  size_t false_positives_{0};
+
+  void writeHeader(bool clean);
+};
+
+// Hash of a tree key for the filter.
+inline uint64_t filterHash(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb3fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+template <size_t N>
+uint64_t filterHash(const FixedString<N>& key) {
+  return filterHash(Hash::hashKey<N>(key));
+}
+
+#endif  // BPT_BLOOM_FILTER_HPP
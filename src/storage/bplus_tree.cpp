@@ -1,31 +1,34 @@
 #include "bplus_tree.hpp"
 
+#include <cassert>
 #include <cstdint>
+#include <filesystem>
 
 #include "../model/order.hpp"
 #include "../model/train.hpp"
-#include "../model/user.hpp"
+#include "../utilities/merge_sort.hpp"
 
-template <class Key, class Value>
-void BPT<Key, Value>::insert(const Key& key, const Value& value) {
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+void BPT<Key, Value, ORDER, LEAF_SIZE>::insert(const Key& key,
+                                               const Value& value) {
   if (root_ == -1) {
-    Block<Key, Value> new_block;
+    BlockNode new_block;
     new_block.data[0] = Key_Value<Key, Value>{key, value};
     new_block.size++;
     new_block.next = -1;
-    int head_ = block_file_.write(new_block);
-    // int head_ = cache_manager_.write_block(new_block);
+    int head_ = cache_manager_.write_block(new_block);
     root_ = head_;
-    block_file_.write_info(head_, 1);
-    // index_file_.write_info(root_, 1);
+    cache_manager_.write_block_info(head_, 1);
     height_ = 0;
+    saveRoot();
     return;
   }
 
-  sjtu::vector<pathFrame<Key, Value>> path;
-  int leaf_addr = findLeafNode({key, value}, path);
+  sjtu::vector<PathFrame> path;
+  Key_Value<Key, Value> entry{key, value};
+  int leaf_addr = findLeafNode(separatorOf(entry), path);
 
-  Key_Value<Key, Value> split_key;
+  Separator<Key, Value> split_key;
   int new_leaf_addr;
   bool leaf_split =
       insertIntoLeaf(leaf_addr, key, value, split_key, new_leaf_addr);
@@ -35,121 +38,260 @@ void BPT<Key, Value>::insert(const Key& key, const Value& value) {
   }
 }
 
-template <class Key, class Value>
-void BPT<Key, Value>::remove(const Key& key, const Value& value) {
-  sjtu::vector<pathFrame<Key, Value>> path;
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+void BPT<Key, Value, ORDER, LEAF_SIZE>::insertBatch(
+    sjtu::vector<Key_Value<Key, Value>>& batch) {
+  if (batch.empty()) {
+    return;
+  }
+  mergeSort(batch, 0, batch.size() - 1);
+  if (root_ == -1) {
+    BlockNode new_block;
+    root_ = cache_manager_.write_block(new_block);
+    cache_manager_.write_block_info(root_, 1);
+    height_ = 0;
+    saveRoot();
+  }
+
+  size_t from = 0;
+  while (from < batch.size()) {
+    Separator<Key, Value> bound;
+    bool bounded;
+    int leaf_addr = findLeafBound(batch[from], bound, bounded);
+    // the leaf takes every entry below the nearest separator to its right
+    size_t to = from + 1;
+    while (to < batch.size() && (!bounded || separatorOf(batch[to]) < bound)) {
+      to++;
+    }
+    mergeIntoLeaf(leaf_addr, batch, from, to);
+    from = to;
+  }
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+void BPT<Key, Value, ORDER, LEAF_SIZE>::mergeIntoLeaf(
+    int leaf_addr, const sjtu::vector<Key_Value<Key, Value>>& batch,
+    size_t from, size_t to) {
+  BlockNode& page = cache_manager_.pin_block_for_write(leaf_addr);
+  size_t total = page.size + (to - from);
+  if (total <= LEAF_SIZE) {
+    // merge from the back so that no entry is moved twice
+    int i = page.size - 1;
+    for (size_t j = to; j > from; --j) {
+      while (i >= 0 && batch[j - 1] < page.data[i]) {
+        page.data[i + (j - from)] = page.data[i];
+        --i;
+      }
+      page.data[i + (j - from)] = batch[j - 1];
+    }
+    page.size = total;
+    cache_manager_.unpin_block(leaf_addr, true);
+    return;
+  }
+  BlockNode leaf = page;
+  cache_manager_.unpin_block(leaf_addr);
+
+  sjtu::vector<Key_Value<Key, Value>> merged(total);
+  size_t i = 0;
+  size_t j = from;
+  while (i < leaf.size || j < to) {
+    if (j == to || (i < leaf.size && leaf.data[i] <= batch[j])) {
+      merged.push_back(leaf.data[i++]);
+    } else {
+      merged.push_back(batch[j++]);
+    }
+  }
+
+  // spread the entries evenly over the old leaf and new ones chained after
+  // it; starts[k] is where the k-th of them begins in merged
+  size_t leaf_count = (total + LEAF_SIZE - 1) / LEAF_SIZE;
+  sjtu::vector<size_t> starts(leaf_count + 1);
+  starts.push_back(0);
+  for (size_t k = 0; k < leaf_count; ++k) {
+    starts.push_back(starts[k] + total / leaf_count +
+                     (k < total % leaf_count ? 1 : 0));
+  }
+
+  // write the new leaves right to left, so each one knows its successor
+  sjtu::vector<int> new_addrs(leaf_count);
+  int next = leaf.next;
+  for (size_t k = leaf_count - 1; k >= 1; --k) {
+    BlockNode new_leaf;
+    new_leaf.size = starts[k + 1] - starts[k];
+    for (size_t t = 0; t < new_leaf.size; ++t) {
+      new_leaf.data[t] = merged[starts[k] + t];
+    }
+    new_leaf.next = next;
+    next = cache_manager_.write_block(new_leaf);
+    new_addrs.push_back(next);
+  }
+  leaf.size = starts[1];
+  for (size_t t = 0; t < leaf.size; ++t) {
+    leaf.data[t] = merged[t];
+  }
+  leaf.next = next;
+  cache_manager_.update_block(leaf, leaf_addr);
+
+  // hang the new leaves into the tree from left to right
+  sjtu::vector<PathFrame> path;
+  for (size_t k = 1; k < leaf_count; ++k) {
+    const Key_Value<Key, Value>& first = merged[starts[k]];
+    Separator<Key, Value> separator = separatorOf(first);
+    findLeafNode(separator, path);
+    insertIntoParent(path, path.size() - 1, separator,
+                     new_addrs[leaf_count - 1 - k]);
+  }
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+void BPT<Key, Value, ORDER, LEAF_SIZE>::remove(const Key& key,
+                                               const Value& value) {
+  sjtu::vector<PathFrame> path;
   Key_Value<Key, Value> kv = Key_Value<Key, Value>{key, value};
-  int leaf_addr = findLeafNode(kv, path);
+  int leaf_addr;
+  if (defer_merges_) {
+    // nothing will climb the path, so skip copying it
+    Separator<Key, Value> bound;
+    bool bounded;
+    leaf_addr = findLeafBound(kv, bound, bounded);
+  } else {
+    leaf_addr = findLeafNode(separatorOf(kv), path);
+  }
   if (leaf_addr == -1) {
     return;
   }
-  Block<Key, Value> leaf;
-  block_file_.read(leaf, leaf_addr);
-  // cache_manager_.read_block(leaf, leaf_addr);
+  BlockNode& leaf = cache_manager_.pin_block_for_write(leaf_addr);
   int pos = -1;
   pos = leaf.size == 0 ? 0 : binarySearch(leaf.data, kv, 0, leaf.size - 1);
   if (pos >= leaf.size || leaf.data[pos] != kv) {
+    cache_manager_.unpin_block(leaf_addr);
     return;
   }
   for (int i = pos; i < leaf.size - 1; ++i) {
     leaf.data[i] = leaf.data[i + 1];
   }
   leaf.size--;
-  if (leaf.size >= (DEFAULT_LEAF_SIZE + 1) / 3) {
-    block_file_.update(leaf, leaf_addr);
-    // cache_manager_.update_block(leaf, leaf_addr);
+  if (leaf.size >= (LEAF_SIZE + 1) / 3 || (defer_merges_ && height_ > 0)) {
+    cache_manager_.unpin_block(leaf_addr, true);
     return;
   }
-  balanceAfterRemove(leaf, leaf_addr, path);
+  // rebalancing works on a copy and writes the leaf back itself
+  BlockNode node = leaf;
+  cache_manager_.unpin_block(leaf_addr, true);
+  balanceLeaf(node, leaf_addr, path, LEAF_SIZE, moveEntry, firstSeparator);
 }
 
-template <class Key, class Value>
-sjtu::vector<Value> BPT<Key, Value>::find(const Key& key) {
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+sjtu::vector<Value> BPT<Key, Value, ORDER, LEAF_SIZE>::find(const Key& key) {
   sjtu::vector<Value> result;
-  size_t level = 1;
-  int ptr = root_;
+  for_each(key, [&result](const Value& value) {
+    result.push_back(value);
+    return true;
+  });
+  return result;
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+typename BPT<Key, Value, ORDER, LEAF_SIZE>::iterator
+BPT<Key, Value, ORDER, LEAF_SIZE>::lower_bound(const Key& key) {
+  int parent, slot;
+  int ptr = descend(key, parent, slot);
   if (ptr == -1) {
-    return result;
-  }
-  if (height_ >= 1) {
-    while (level < height_) {
-      Index<Key, Value> index;
-      index_file_.read(index, ptr);
-      // cache_manager_.read_index(index, ptr);
-      int idx = binarySearch(index.keys, key, 0, index.size - 1);
-      ptr = index.children[idx];
-      level++;
-    }
-    Index<Key, Value> index;
-    index_file_.read(index, ptr);
-    // cache_manager_.read_index(index, ptr);
-    int idx = binarySearch(index.keys, key, 0, index.size - 1);
-    ptr = index.children[idx];
-  }
-
-  Block<Key, Value> block;
-  block_file_.read(block, ptr);
-  // cache_manager_.read_block(block, ptr);
-  int idx = binarySearch(block.data, key, 0, block.size - 1);
-  if (idx >= block.size) {
-    ptr = block.next;
-    if (ptr == -1) {
-      return result;
-    }
-    block_file_.read(block, ptr);
-    // cache_manager_.read_block(block, ptr);
-    idx = 0;
-  } else if (block.data[idx].key > key) {
-    return result;
-  }
-  while (true) {
-    if (idx == block.size) {
-      ptr = block.next;
-      if (ptr == -1) {
-        return result;
-      }
-      block_file_.read(block, ptr);
-      // cache_manager_.read_block(block, ptr);
-      idx = 0;
-    }
-    if (block.data[idx].key > key) {
-      return result;
-    }
-    result.push_back(block.data[idx].value);
-    ++idx;
+    return end();
+  }
+  const BlockNode& block = cache_manager_.pin_block(ptr);
+  int idx = block.size == 0 ? 0 : binarySearch(block.data, key, 0,
+                                                block.size - 1);
+  cache_manager_.unpin_block(ptr);
+  return iterator(this, ptr, idx, parent, slot);
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+int BPT<Key, Value, ORDER, LEAF_SIZE>::descend(const Key& key) {
+  int parent, slot;
+  return descend(key, parent, slot);
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+int BPT<Key, Value, ORDER, LEAF_SIZE>::descend(const Key& key, int& parent,
+                                               int& slot) {
+  int ptr = root_;
+  parent = -1;
+  slot = 0;
+  for (int level = 1; ptr != -1 && level <= height_; level++) {
+    const IndexNode& index = cache_manager_.pin_index(ptr);
+    parent = ptr;
+    slot = binarySearch(index.keys, key, 0, index.size - 1);
+    int next = index.children[slot];
+    cache_manager_.unpin_index(ptr);
+    ptr = next;
   }
+  return ptr;
 }
 
-template <class Key, class Value>
-int BPT<Key, Value>::findLeafNode(const Key_Value<Key, Value>& key,
-                                  sjtu::vector<pathFrame<Key, Value>>& path) {
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+int BPT<Key, Value, ORDER, LEAF_SIZE>::descendTo(
+    const Key_Value<Key, Value>& entry, int& parent, int& slot) {
+  Separator<Key, Value> separator = separatorOf(entry);
   int ptr = root_;
-  path.clear();
-  if (ptr == -1) {
-    return -1;
-  }
-  for (int level = 1; level <= height_; level++) {
-    Index<Key, Value> node;
-    index_file_.read(node, ptr);
-    // cache_manager_.read_index(node, ptr);
-    int idx = (node.size == 0)
-                  ? 0
-                  : binarySearchForBigOrEqual(node.keys, key, 0, node.size - 1);
-    path.push_back({node, ptr, idx});
-    ptr = node.children[idx];
+  parent = -1;
+  slot = 0;
+  for (int level = 1; ptr != -1 && level <= height_; level++) {
+    const IndexNode& index = cache_manager_.pin_index(ptr);
+    parent = ptr;
+    slot = index.size == 0 ? 0
+                           : binarySearchForBigOrEqual(index.keys, separator,
+                                                       0, index.size - 1);
+    int next = index.children[slot];
+    cache_manager_.unpin_index(ptr);
+    ptr = next;
   }
   return ptr;
 }
 
-template <class Key, class Value>
-bool BPT<Key, Value>::insertIntoLeaf(int leaf_addr, const Key& key,
-                                     const Value& value,
-                                     Key_Value<Key, Value>& split_key,
-                                     int& new_leaf_addr) {
-  Block<Key, Value> leaf;
-  block_file_.read(leaf, leaf_addr);
-  // cache_manager_.read_block(leaf, leaf_addr);
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+int BPT<Key, Value, ORDER, LEAF_SIZE>::readAheadLeaves(int parent, int slot) {
+  const IndexNode& index = cache_manager_.pin_index(parent);
+  int last = index.size;
+  int end = -1;
+  if (slot <= last) {
+    end = slot + BPT_READAHEAD <= last + 1 ? slot + BPT_READAHEAD : last + 1;
+    cache_manager_.prefetch_blocks(index.children + slot, end - slot);
+  }
+  cache_manager_.unpin_index(parent);
+  return end;
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+int BPT<Key, Value, ORDER, LEAF_SIZE>::findLeafBound(
+    const Key_Value<Key, Value>& key, Separator<Key, Value>& bound,
+    bool& bounded) {
+  Separator<Key, Value> separator = separatorOf(key);
+  bounded = false;
+  int ptr = root_;
+  for (int level = 1; ptr != -1 && level <= height_; level++) {
+    const IndexNode& node = cache_manager_.pin_index(ptr);
+    int idx = (node.size == 0) ? 0
+                               : binarySearchForBigOrEqual(node.keys, separator,
+                                                           0, node.size - 1);
+    // deeper bounds are tighter
+    if (idx < node.size) {
+      bound = node.keys[idx];
+      bounded = true;
+    }
+    int next = node.children[idx];
+    cache_manager_.unpin_index(ptr);
+    ptr = next;
+  }
+  return ptr;
+}
 
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+bool BPT<Key, Value, ORDER, LEAF_SIZE>::insertIntoLeaf(
+    int leaf_addr, const Key& key, const Value& value,
+    Separator<Key, Value>& split_key, int& new_leaf_addr) {
+  // a leaf has one spare slot, so the entry always goes in place first
+  BlockNode& leaf = cache_manager_.pin_block_for_write(leaf_addr);
   int pos = (leaf.size == 0)
                 ? 0
                 : binarySearch(leaf.data, {key, value}, 0, leaf.size - 1);
@@ -158,427 +300,200 @@ bool BPT<Key, Value>::insertIntoLeaf(int leaf_addr, const Key& key,
   }
   leaf.data[pos] = Key_Value<Key, Value>{key, value};
   leaf.size++;
-  block_file_.update(leaf, leaf_addr);
-  // cache_manager_.update_block(leaf, leaf_addr);
+  bool overflow = leaf.size == LEAF_SIZE + 1;
+  cache_manager_.unpin_block(leaf_addr, true);
 
-  if (leaf.size == DEFAULT_LEAF_SIZE + 1) {
-    return splitLeaf(leaf, leaf_addr, split_key, new_leaf_addr);
+  if (overflow) {
+    return splitLeaf(leaf_addr, split_key, new_leaf_addr);
   }
   return false;
 }
 
-template <class Key, class Value>
-bool BPT<Key, Value>::splitLeaf(Block<Key, Value>& leaf, int leaf_addr,
-                                Key_Value<Key, Value>& split_key,
-                                int& new_leaf_addr) {
-  int mid = (DEFAULT_LEAF_SIZE + 1) / 2;
-  Block<Key, Value> new_leaf;
-  new_leaf.size = DEFAULT_LEAF_SIZE + 1 - mid;
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+bool BPT<Key, Value, ORDER, LEAF_SIZE>::splitLeaf(
+    int leaf_addr, Separator<Key, Value>& split_key, int& new_leaf_addr) {
+  int mid = (LEAF_SIZE + 1) / 2;
+  BlockNode new_leaf;
+  BlockNode& leaf = cache_manager_.pin_block_for_write(leaf_addr);
+  new_leaf.size = LEAF_SIZE + 1 - mid;
   for (int i = 0; i < new_leaf.size; ++i) {
     new_leaf.data[i] = leaf.data[i + mid];
   }
   leaf.size = mid;
   new_leaf.next = leaf.next;
-  split_key = new_leaf.data[0];
-  new_leaf_addr = block_file_.write(new_leaf);
-  // new_leaf_addr = cache_manager_.write_block(new_leaf);
-  leaf.next = new_leaf_addr;
-  block_file_.update(leaf, leaf_addr);
-  // cache_manager_.update_block(leaf, leaf_addr);
-  return true;
-}
-
-template <class Key, class Value>
-bool BPT<Key, Value>::insertIntoParent(
-    const sjtu::vector<pathFrame<Key, Value>>& path, int level,
-    const Key_Value<Key, Value>& key, int right_child) {
-  if (level < 0) {
-    Index<Key, Value> new_root;
-    new_root.size = 1;
-    new_root.keys[0] = key;
-    new_root.children[0] = path.empty() ? root_ : path[0].index_addr;
-    new_root.children[1] = right_child;
-    root_ = index_file_.write(new_root);
-    // root_ = cache_manager_.write_index(new_root);
-    // index_file_.write_info(root_, 1);
-    height_++;
-    return true;
-  }
-  auto [parent, parent_addr, child_idx] = path[level];
-
-  for (int i = parent.size; i > child_idx; --i) {
-    parent.keys[i] = parent.keys[i - 1];
-    parent.children[i + 1] = parent.children[i];
-  }
-  parent.keys[child_idx] = key;
-  parent.children[child_idx + 1] = right_child;
-  parent.size++;
-  if (parent.size < DEFAULT_ORDER) {
-    index_file_.update(parent, parent_addr);
-    // cache_manager_.update_index(parent, parent_addr);
-    return false;
-  }
-
-  Key_Value<Key, Value> new_split_key;
-  int new_index_addr;
-  bool result =
-      splitInternal(parent, parent_addr, new_split_key, new_index_addr);
-  if (result) {
-    return insertIntoParent(path, level - 1, new_split_key, new_index_addr);
-  }
-  return false;
-}
-
-template <class Key, class Value>
-bool BPT<Key, Value>::splitInternal(Index<Key, Value>& node, int node_addr,
-                                    Key_Value<Key, Value>& split_key,
-                                    int& new_node_addr) {
-  Index<Key, Value> new_node;
-  int split_pos = DEFAULT_ORDER / 2;
-  new_node.size = DEFAULT_ORDER - split_pos - 1;
-  for (int i = 0; i < new_node.size; ++i) {
-    new_node.keys[i] = node.keys[i + split_pos + 1];
-    new_node.children[i] = node.children[i + split_pos + 1];
-  }
-  new_node.children[new_node.size] = node.children[DEFAULT_ORDER];
-  split_key = node.keys[split_pos];
-  node.size = split_pos;
-  index_file_.update(node, node_addr);
-  new_node_addr = index_file_.write(new_node);
-  // cache_manager_.update_index(node, node_addr);
-  // new_node_addr = cache_manager_.write_index(new_node);
+  cache_manager_.unpin_block(leaf_addr, true);
+  split_key = separatorOf(new_leaf.data[0]);
+  // writing may move a mapped file, so the leaf is pinned again for the
+  // link once the new leaf has its address
+  new_leaf_addr = cache_manager_.write_block(new_leaf);
+  cache_manager_.pin_block_for_write(leaf_addr).next = new_leaf_addr;
+  cache_manager_.unpin_block(leaf_addr, true);
   return true;
 }
 
-template <class Key, class Value>
-void BPT<Key, Value>::balanceAfterRemove(
-    Block<Key, Value>& node, int node_addr,
-    sjtu::vector<pathFrame<Key, Value>>& path) {
-  if (path.empty()) {
-    if (node.size == 0) {
-      root_ = -1;
-      height_ = 0;
-      return;
-    } else {
-      block_file_.update(node, node_addr);
-      // cache_manager_.update_block(node, node_addr);
-      return;
-    }
-  }
-  auto [parent, parent_addr, child_idx] = path.back();
-  path.pop_back();
-  Block<Key, Value> left_sibling;
-  int left_sibling_addr;
-  if (child_idx >= 1) {
-    left_sibling_addr = parent.children[child_idx - 1];
-    block_file_.read(left_sibling, left_sibling_addr);
-    // cache_manager_.read_block(left_sibling, left_sibling_addr);
-    if (left_sibling.size > (DEFAULT_LEAF_SIZE + 1) / 2) {
-      for (int i = node.size; i >= 1; --i) {
-        node.data[i] = node.data[i - 1];
-      }
-      node.data[0] = left_sibling.data[left_sibling.size - 1];
-      node.size++;
-      left_sibling.size--;
-      parent.keys[child_idx - 1] = node.data[0];
-      block_file_.update(node, node_addr);
-      block_file_.update(left_sibling, left_sibling_addr);
-      index_file_.update(parent, parent_addr);
-      // cache_manager_.update_block(node, node_addr);
-      // cache_manager_.update_block(left_sibling, left_sibling_addr);
-      // cache_manager_.update_index(parent, parent_addr);
-      return;
-    }
-  }
-  Block<Key, Value> right_sibling;
-  int right_sibling_addr;
-  if (child_idx <= parent.size - 1) {
-    right_sibling_addr = parent.children[child_idx + 1];
-    block_file_.read(right_sibling, right_sibling_addr);
-    // cache_manager_.read_block(right_sibling, right_sibling_addr);
-    if (right_sibling.size > (DEFAULT_LEAF_SIZE + 1) / 2) {
-      node.data[node.size] = right_sibling.data[0];
-      for (int i = 0; i <= right_sibling.size - 2; ++i) {
-        right_sibling.data[i] = right_sibling.data[i + 1];
-      }
-      node.size++;
-      right_sibling.size--;
-      parent.keys[child_idx] = right_sibling.data[0];
-      block_file_.update(node, node_addr);
-      block_file_.update(right_sibling, right_sibling_addr);
-      index_file_.update(parent, parent_addr);
-      // cache_manager_.update_block(node, node_addr);
-      // cache_manager_.update_block(right_sibling, right_sibling_addr);
-      // cache_manager_.update_index(parent, parent_addr);
-      return;
-    }
-  }
-
-  if (child_idx >= 1) {
-    for (int i = 0; i < node.size; ++i) {
-      left_sibling.data[left_sibling.size + i] = node.data[i];
-    }
-    left_sibling.size += node.size;
-    left_sibling.next = node.next;
-    block_file_.update(left_sibling, left_sibling_addr);
-    // cache_manager_.update_block(left_sibling, left_sibling_addr);
-    removeFromParent(parent, parent_addr, child_idx - 1, path);
-  } else if (child_idx <= parent.size - 1) {
-    for (int i = 0; i < right_sibling.size; ++i) {
-      node.data[node.size + i] = right_sibling.data[i];
-    }
-    node.size += right_sibling.size;
-    node.next = right_sibling.next;
-    block_file_.update(node, node_addr);
-    // cache_manager_.update_block(node, node_addr);
-    removeFromParent(parent, parent_addr, child_idx, path);
-  }
-}
-
-template <class Key, class Value>
-void BPT<Key, Value>::removeFromParent(
-    Index<Key, Value>& parent, int parent_addr, int key_idx,
-    sjtu::vector<pathFrame<Key, Value>>& path) {
-  for (int i = key_idx; i < parent.size - 1; ++i) {
-    parent.keys[i] = parent.keys[i + 1];
-  }
-  for (int i = key_idx + 1; i < parent.size; ++i) {
-    parent.children[i] = parent.children[i + 1];
-  }
-  parent.size--;
-  if (path.empty() && parent.size == 0) {
-    root_ = parent.children[0];
-    height_--;
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+void BPT<Key, Value, ORDER, LEAF_SIZE>::update(const Key& key,
+                                               const Value& new_value) {
+  // the entry may sit at the head of the next leaf, which the cursor finds
+  iterator it = lower_bound(key);
+  if (it == end() || it->key != key) {
     return;
   }
-  if (path.empty() || parent.size >= DEFAULT_ORDER / 3) {
-    index_file_.update(parent, parent_addr);
-    // cache_manager_.update_index(parent, parent_addr);
-    return;
-  }
-  balanceInternalNode(parent, parent_addr, path);
-}
-
-template <class Key, class Value>
-void BPT<Key, Value>::balanceInternalNode(
-    Index<Key, Value>& node, int node_addr,
-    sjtu::vector<pathFrame<Key, Value>>& path) {
-  auto [parent, parent_addr, node_idx] = path.back();
-  path.pop_back();
-  Index<Key, Value> left_sibling;
-  int left_sibling_addr;
-  if (node_idx >= 1) {
-    left_sibling_addr = parent.children[node_idx - 1];
-    index_file_.read(left_sibling, left_sibling_addr);
-    // cache_manager_.read_index(left_sibling, left_sibling_addr);
-
-    if (left_sibling.size > DEFAULT_ORDER / 2) {
-      for (int i = node.size; i > 0; --i) {
-        node.keys[i] = node.keys[i - 1];
-      }
-      for (int i = node.size + 1; i > 0; --i) {
-        node.children[i] = node.children[i - 1];
-      }
-      node.keys[0] = parent.keys[node_idx - 1];
-      node.children[0] = left_sibling.children[left_sibling.size];
-      parent.keys[node_idx - 1] = left_sibling.keys[left_sibling.size - 1];
-      node.size++;
-      left_sibling.size--;
-      index_file_.update(node, node_addr);
-      index_file_.update(left_sibling, left_sibling_addr);
-      index_file_.update(parent, parent_addr);
-      // cache_manager_.update_index(node, node_addr);
-      // cache_manager_.update_index(left_sibling, left_sibling_addr);
-      // cache_manager_.update_index(parent, parent_addr);
-      return;
-    }
-  }
-
-  Index<Key, Value> right_sibling;
-  int right_sibling_addr;
-  if (node_idx <= parent.size - 1) {
-    right_sibling_addr = parent.children[node_idx + 1];
-    index_file_.read(right_sibling, right_sibling_addr);
-    // cache_manager_.read_index(right_sibling, right_sibling_addr);
-
-    if (right_sibling.size > DEFAULT_ORDER / 2) {
-      node.keys[node.size] = parent.keys[node_idx];
-      node.children[node.size + 1] = right_sibling.children[0];
-      parent.keys[node_idx] = right_sibling.keys[0];
-      node.size++;
-      for (int i = 0; i < right_sibling.size - 1; ++i) {
-        right_sibling.keys[i] = right_sibling.keys[i + 1];
-      }
-      for (int i = 0; i < right_sibling.size; ++i) {
-        right_sibling.children[i] = right_sibling.children[i + 1];
-      }
-      right_sibling.size--;
-      index_file_.update(node, node_addr);
-      index_file_.update(right_sibling, right_sibling_addr);
-      index_file_.update(parent, parent_addr);
-      // cache_manager_.update_index(node, node_addr);
-      // cache_manager_.update_index(right_sibling, right_sibling_addr);
-      // cache_manager_.update_index(parent, parent_addr);
-      return;
-    }
-  }
-
-  if (node_idx >= 1) {
-    left_sibling.keys[left_sibling.size] = parent.keys[node_idx - 1];
-    for (int i = 0; i < node.size; ++i) {
-      left_sibling.keys[left_sibling.size + 1 + i] = node.keys[i];
-    }
-    for (int i = 0; i <= node.size; ++i) {
-      left_sibling.children[left_sibling.size + 1 + i] = node.children[i];
-    }
-    left_sibling.size += node.size + 1;
-    index_file_.update(left_sibling, left_sibling_addr);
-    // cache_manager_.update_index(left_sibling, left_sibling_addr);
-    removeFromParent(parent, parent_addr, node_idx - 1, path);
-  } else if (node_idx <= parent.size - 1) {
-    node.keys[node.size] = parent.keys[node_idx];
-    for (int i = 0; i < right_sibling.size; ++i) {
-      node.keys[node.size + 1 + i] = right_sibling.keys[i];
-    }
-    for (int i = 0; i <= right_sibling.size; ++i) {
-      node.children[node.size + 1 + i] = right_sibling.children[i];
-    }
-    node.size += right_sibling.size + 1;
-    index_file_.update(node, node_addr);
-    // cache_manager_.update_index(node, node_addr);
-    removeFromParent(parent, parent_addr, node_idx, path);
-  }
+  int leaf = it.leaf_;
+  size_t idx = it.idx_;
+  cache_manager_.pin_block_for_write(leaf).data[idx].value = new_value;
+  cache_manager_.unpin_block(leaf, true);
 }
 
-template <class Key, class Value>
-void BPT<Key, Value>::update(const Key& key, const Value& new_value) {
-  size_t level = 1;
-  int ptr = root_;
-  if (ptr == -1) {
-    return;
-  }
-  if (height_ >= 1) {
-    while (level < height_) {
-      Index<Key, Value> index;
-      index_file_.read(index, ptr);
-      // cache_manager_.read_index(index, ptr);
-      int idx = binarySearch(index.keys, key, 0, index.size - 1);
-      ptr = index.children[idx];
-      level++;
-    }
-    Index<Key, Value> index;
-    index_file_.read(index, ptr);
-    // cache_manager_.read_index(index, ptr);
-    int idx = binarySearch(index.keys, key, 0, index.size - 1);
-    ptr = index.children[idx];
-  }
-
-  Block<Key, Value> block;
-  block_file_.read(block, ptr);
-  // cache_manager_.read_block(block, ptr);
-  int idx = binarySearch(block.data, key, 0, block.size - 1);
-  if (idx >= block.size) {
-    ptr = block.next;
-    if (ptr == -1) {
-      return;
-    }
-    block_file_.read(block, ptr);
-    // cache_manager_.read_block(block, ptr);
-    idx = 0;
-  }
-  if (block.data[idx].key != key) {
-    return;
-  }
-  block.data[idx].value = new_value;
-  block_file_.update(block, ptr);
-  // cache_manager_.update_block(block, ptr);
-}
-
-template <class Key, class Value>
-void BPT<Key, Value>::update(const Key& key, const Value& new_value,
-                             const Value& old_value) {
-  sjtu::vector<pathFrame<Key, Value>> path;
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+void BPT<Key, Value, ORDER, LEAF_SIZE>::update(const Key& key,
+                                               const Value& new_value,
+                                               const Value& old_value) {
   Key_Value<Key, Value> kv = Key_Value<Key, Value>{key, old_value};
-  int leaf_addr = findLeafNode(kv, path);
+  Separator<Key, Value> bound;
+  bool bounded;
+  int leaf_addr = findLeafBound(kv, bound, bounded);
   if (leaf_addr == -1) {
     return;
   }
-  Block<Key, Value> leaf;
-  block_file_.read(leaf, leaf_addr);
-  // cache_manager_.read_block(leaf, leaf_addr);
+  BlockNode& leaf = cache_manager_.pin_block_for_write(leaf_addr);
   int pos = -1;
   pos = leaf.size == 0 ? 0 : binarySearch(leaf.data, kv, 0, leaf.size - 1);
-  if (pos >= leaf.size || leaf.data[pos] != kv) {
-    return;
+  bool found = pos < leaf.size && leaf.data[pos] == kv;
+  if (found) {
+    leaf.data[pos].value = new_value;
   }
-  leaf.data[pos].value = new_value;
-  block_file_.update(leaf, leaf_addr);
-  // cache_manager_.update_block(leaf, leaf_addr);
+  cache_manager_.unpin_block(leaf_addr, found);
 }
 
-template <class Key, class Value>
-int BPT<Key, Value>::findLeafNode(const Key& key,
-                                  sjtu::vector<pathFrame<Key, Value>>& path) {
-  int ptr = root_;
-  path.clear();
-  if (ptr == -1) {
-    return -1;
-  }
-  for (int level = 1; level <= height_; level++) {
-    Index<Key, Value> node;
-    index_file_.read(node, ptr);
-    // cache_manager_.read_index(node, ptr);
-    int idx = (node.size == 0)
-                  ? 0
-                  : binarySearchForBigOrEqual(node.keys, key, 0, node.size - 1);
-    path.push_back({node, ptr, idx});
-    ptr = node.children[idx];
-  }
-  return ptr;
-}
-
-template <class Key, class Value>
-void BPT<Key, Value>::remove(const Key& key) {
-  sjtu::vector<pathFrame<Key, Value>> path;
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+void BPT<Key, Value, ORDER, LEAF_SIZE>::remove(const Key& key) {
+  sjtu::vector<PathFrame> path;
   int leaf_addr = findLeafNode(key, path);
   if (leaf_addr == -1) {
     return;
   }
-  Block<Key, Value> leaf;
-  block_file_.read(leaf, leaf_addr);
-  // cache_manager_.read_block(leaf, leaf_addr);
+  BlockNode& leaf = cache_manager_.pin_block_for_write(leaf_addr);
   int pos = -1;
   pos = leaf.size == 0 ? 0 : binarySearch(leaf.data, key, 0, leaf.size - 1);
   if (pos >= leaf.size || leaf.data[pos].key != key) {
+    cache_manager_.unpin_block(leaf_addr);
     return;
   }
   for (int i = pos; i < leaf.size - 1; ++i) {
     leaf.data[i] = leaf.data[i + 1];
   }
   leaf.size--;
-  if (leaf.size >= (DEFAULT_LEAF_SIZE + 1) / 3) {
-    block_file_.update(leaf, leaf_addr);
-    // cache_manager_.update_block(leaf, leaf_addr);
+  if (leaf.size >= (LEAF_SIZE + 1) / 3 || (defer_merges_ && height_ > 0)) {
+    cache_manager_.unpin_block(leaf_addr, true);
     return;
   }
-  balanceAfterRemove(leaf, leaf_addr, path);
+  BlockNode node = leaf;
+  cache_manager_.unpin_block(leaf_addr, true);
+  balanceLeaf(node, leaf_addr, path, LEAF_SIZE, moveEntry, firstSeparator);
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+bool BPT<Key, Value, ORDER, LEAF_SIZE>::empty() {
+  // with merges deferred, leaves may stay behind with nothing in them
+  for (int ptr = leftmostLeaf(); ptr != -1;) {
+    const BlockNode& block = cache_manager_.pin_block(ptr);
+    size_t size = block.size;
+    int next = block.next;
+    cache_manager_.unpin_block(ptr);
+    if (size > 0) {
+      return false;
+    }
+    ptr = next;
+  }
+  return true;
 }
 
-template <class Key, class Value>
-bool BPT<Key, Value>::empty() {
-  return root_ == -1;
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+bool BPT<Key, Value, ORDER, LEAF_SIZE>::exists(const Key& key) {
+  iterator it = lower_bound(key);
+  return it != end() && it->key == key;
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+template <class Source>
+void BPT<Key, Value, ORDER, LEAF_SIZE>::rebuild(size_t total, Source next) {
+  std::string index_tmp = filename_ + ".index.tmp";
+  std::string block_tmp = filename_ + ".block.tmp";
+  int new_root = -1;
+  int new_height = 0;
+  {
+    IndexRiver new_index(index_tmp);
+    BlockRiver new_block(block_tmp);
+    new_index.initialise();
+    new_block.initialise();
+
+    // leaves, filled evenly and chained in key order
+    sjtu::vector<Separator<Key, Value>> first_keys;
+    sjtu::vector<int> addrs;
+    size_t leaf_count = (total + LEAF_SIZE - 1) / LEAF_SIZE;
+    BlockNode prev;
+    int prev_addr = -1;
+    for (size_t i = 0; i < leaf_count; ++i) {
+      size_t count = total / leaf_count + (i < total % leaf_count ? 1 : 0);
+      BlockNode leaf;
+      while (leaf.size < count) {
+        leaf.data[leaf.size] = next();
+        // the entry before it is in this leaf, or last in the previous one
+        assert((i == 0 && leaf.size == 0) ||
+               compareKeys(leaf.size > 0 ? leaf.data[leaf.size - 1]
+                                         : prev.data[prev.size - 1],
+                           leaf.data[leaf.size]) <= 0);
+        leaf.size++;
+      }
+      int addr = new_block.write(leaf);
+      if (prev_addr != -1) {
+        prev.next = addr;
+        new_block.update(prev, prev_addr);
+      } else {
+        new_block.write_info(addr, 1);
+      }
+      first_keys.push_back(separatorOf(leaf.data[0]));
+      addrs.push_back(addr);
+      prev = leaf;
+      prev_addr = addr;
+    }
+
+    buildIndex(new_index, first_keys, addrs, new_root, new_height);
+    new_index.write_info(new_root, 1);
+    new_index.write_info(new_height, 2);
+  }
+
+  cache_manager_.reset();
+  swapFiles();
+  root_ = new_root;
+  height_ = new_height;
 }
 
-template <class Key, class Value>
-bool BPT<Key, Value>::exists(const Key& key) {
-  return !find(key).empty();
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+void BPT<Key, Value, ORDER, LEAF_SIZE>::compact() {
+  // number of live entries
+  int leaf_addr = leftmostLeaf();
+  size_t total = 0;
+  for (int ptr = leaf_addr; ptr != -1;) {
+    const BlockNode& block = cache_manager_.pin_block(ptr);
+    total += block.size;
+    int next = block.next;
+    cache_manager_.unpin_block(ptr);
+    ptr = next;
+  }
+
+  // the cursor ends past the last entry, so no leaf is left pinned once
+  // the files are swapped
+  iterator it(this, leaf_addr, 0);
+  rebuild(total, [&it]() {
+    Key_Value<Key, Value> entry = *it;
+    ++it;
+    return entry;
+  });
 }
 
-template class BPT<uint64_t, User>;
-template class BPT<FixedString<20>, Train>;
 template class BPT<FixedString<20>, int>;
 template class BPT<uint64_t, FixedString<20>>;
-template class BPT<FixedString<20>, Order>;
-template class BPT<uint64_t, Order>;
-template class BPT<FixedString<30>, FixedString<20>>;
-template class BPT<Route, FixedString<20>>;
\ No newline at end of file
+template class BPT<FixedString<20>, OrderRef>;
+template class BPT<uint64_t, OrderRef>;
\ No newline at end of file
@@ -2,115 +2,32 @@
 #include <string>
 
 #include "../stl/vector.hpp"
-// #include "cache.hpp"
+#include "bplus_tree_base.hpp"
 #include "index_block.hpp"
-#include "memory_river.hpp"
-
-template <class Key, class Value>
-struct pathFrame {
-  Index<Key, Value> index;
-  int index_addr;
-  int pos;
-};
-
-template <class Key, class Value>
-int binarySearch(Key_Value<Key, Value>* array, const Key& key, int left,
-                 int right) {
-  if (key <= array[left].key) return left;
-  if (key > array[right].key) return right + 1;
-
-  int l = left, r = right;
-  while (l < r) {
-    int mid = l + (r - l) / 2;
-    if (array[mid].key < key) {
-      l = mid + 1;
-    } else {
-      r = mid;
-    }
-  }
-  return l;
-}
-
-template <class Key>
-int binarySearch(Key* array, const Key& key, int left, int right) {
-  if (key <= array[left]) return left;
-  if (key > array[right]) return right + 1;
-
-  int l = left, r = right;
-  while (l < r) {
-    int mid = l + (r - l) / 2;
-    if (array[mid] < key) {
-      l = mid + 1;
-    } else {
-      r = mid;
-    }
-  }
-  return l;
-}
-
-template <class Key>
-int binarySearchForBigOrEqual(Key* array, const Key& key, int left, int right) {
-  if (key < array[left]) return left;
-  if (key >= array[right]) return right + 1;
-
-  int l = left, r = right;
-  while (l < r) {
-    int mid = l + (r - l) / 2;
-    if (array[mid] < key) {
-      l = mid + 1;
-    } else if (array[mid] > key) {
-      r = mid;
-    } else {
-      return mid + 1;
-    }
-  }
-  return l;
-}
-
-template <class Key, class Value>
-int binarySearchForBigOrEqual(Key_Value<Key, Value>* array, const Key& key,
-                              int left, int right) {
-  if (key < array[left].key) return left;
-  if (key >= array[right].key) return right + 1;
-
-  int l = left, r = right;
-  while (l < r) {
-    int mid = l + (r - l) / 2;
-    if (array[mid].key < key) {
-      l = mid + 1;
-    } else if (array[mid].key > key) {
-      r = mid;
-    } else {
-      return mid + 1;
-    }
-  }
-  return l;
-}
 
-template <class Key, class Value>
-class BPT {
+// Leaves a scan reads ahead in one batch once it crosses into the next
+// leaf, see BPT::iterator; 0 turns readahead off.
+#ifndef BPT_READAHEAD
+#define BPT_READAHEAD 4
+#endif
+
+// ORDER and LEAF_SIZE default to filling whole pages, see index_block.hpp.
+template <class Key, class Value, size_t ORDER = defaultOrder<Key, Value>(),
+          size_t LEAF_SIZE = defaultLeafSize<Key, Value>()>
+class BPT : public BPTBase<Index<Key, Value, ORDER>,
+                           Block<Key, Value, LEAF_SIZE>,
+                           Separator<Key, Value>, ORDER> {
+  using IndexNode = Index<Key, Value, ORDER>;
+  using BlockNode = Block<Key, Value, LEAF_SIZE>;
+  using Base = BPTBase<IndexNode, BlockNode, Separator<Key, Value>, ORDER>;
+  using typename Base::BlockRiver;
+  using typename Base::IndexRiver;
+  using typename Base::PathFrame;
+
  public:
   BPT(const std::string& filename = "database")
-      : filename_(filename),
-        index_file_(filename + ".index"),
-        block_file_(filename + ".block")
-  // cache_manager_(index_file_, block_file_)
-  {
-    if (!index_file_.exist()) {
-      index_file_.initialise();
-      block_file_.initialise();
-      root_ = -1;
-      height_ = 0;
-    } else {
-      index_file_.get_info(root_, 1);
-      index_file_.get_info(height_, 2);
-    }
-  }
-  ~BPT() {
-    // cache_manager_.flush_cache();
-    index_file_.write_info(root_, 1);
-    index_file_.write_info(height_, 2);
-  }
+      : Base(filename, FILES, 2) {}
+  ~BPT() { cache_manager_.flush_cache(); }
   void insert(const Key& key, const Value& value);
   void remove(const Key& key, const Value& value);
   sjtu::vector<Value> find(const Key& key);
@@ -124,46 +41,217 @@ class BPT {
   // special interface for key-multiple-values, but value's ordering consistent
   void update(const Key& key, const Value& new_value, const Value& old_value);
 
+  // rewrite both files densely, dropping every recycled slot
+  void compact();
+
+  // Leave underfull and empty leaves in place on remove instead of
+  // borrowing from or merging with a sibling, so a removal writes only its
+  // leaf. compact() packs the tree again.
+  void deferMerges(bool on) { defer_merges_ = on; }
+
+  // internal node reads answered from memory, and those that went to the
+  // buffer pool, see BPT_RESIDENT_INDEX
+  size_t residentIndexHits() const { return cache_manager_.residentHits(); }
+  size_t residentIndexLoads() const { return cache_manager_.residentLoads(); }
+
+  // insert many entries at once; the batch is sorted and every affected
+  // leaf is rewritten once instead of once per entry
+  void insertBatch(sjtu::vector<Key_Value<Key, Value>>& batch);
+
+  // Forward cursor along the leaf chain. It keeps the leaf it points into
+  // pinned, so the tree must not be modified while a cursor is alive.
+  // Once a scan moves on to the next leaf, the following BPT_READAHEAD
+  // siblings under the same parent are read into the buffer pool in one
+  // batch, so a long run of values does not wait on each leaf in turn.
+  // When the scan leaves the parent, the next one is found by descending
+  // to the first entry of the leaf it has reached.
+  class iterator {
+   public:
+    iterator(iterator&& other) noexcept
+        : tree_(other.tree_),
+          leaf_(other.leaf_),
+          block_(other.block_),
+          idx_(other.idx_),
+          parent_(other.parent_),
+          slot_(other.slot_),
+          fetched_(other.fetched_) {
+      other.leaf_ = -1;
+    }
+    iterator(const iterator&) = delete;
+    iterator& operator=(const iterator&) = delete;
+    ~iterator() {
+      if (leaf_ != -1) {
+        tree_->cache_manager_.unpin_block(leaf_);
+      }
+    }
+
+    const Key_Value<Key, Value>& operator*() const {
+      return block_->data[idx_];
+    }
+    const Key_Value<Key, Value>* operator->() const {
+      return &block_->data[idx_];
+    }
+    iterator& operator++() {
+      ++idx_;
+      skipExhausted(true);
+      return *this;
+    }
+    bool operator==(const iterator& other) const {
+      return leaf_ == other.leaf_ && (leaf_ == -1 || idx_ == other.idx_);
+    }
+    bool operator!=(const iterator& other) const { return !(*this == other); }
+
+   private:
+    friend class BPT;
+    BPT* tree_;
+    int leaf_;
+    const BlockNode* block_{nullptr};
+    size_t idx_;
+    // index node above leaf_ and the slot of leaf_ in it, -1 once the
+    // scan has left that node
+    int parent_{-1};
+    int slot_{0};
+    // first slot that has not been read ahead yet
+    int fetched_{0};
+
+    iterator(BPT* tree, int leaf, size_t idx, int parent = -1, int slot = 0)
+        : tree_(tree),
+          leaf_(leaf),
+          idx_(idx),
+          parent_(parent),
+          slot_(slot),
+          fetched_(slot + 1) {
+      if (leaf_ != -1) {
+        block_ = &tree_->cache_manager_.pin_block(leaf_);
+        skipExhausted(false);
+      }
+    }
+
+    // move on to the next leaf once this one is used up; a lookup that
+    // lands at the end of a leaf only steps over, a scan reads ahead
+    void skipExhausted(bool scanning) {
+      while (leaf_ != -1 && idx_ >= block_->size) {
+        int next = block_->next;
+        tree_->cache_manager_.unpin_block(leaf_);
+        leaf_ = next;
+        idx_ = 0;
+        if (leaf_ != -1) {
+          readAhead(scanning);
+          block_ = &tree_->cache_manager_.pin_block(leaf_);
+          if (scanning && parent_ == -1) {
+            findParent();
+          }
+        }
+      }
+    }
+
+    void findParent() {
+      if (BPT_READAHEAD <= 0 || block_->size == 0) {
+        return;
+      }
+      int parent, slot;
+      if (tree_->descendTo(block_->data[0], parent, slot) == leaf_) {
+        parent_ = parent;
+        slot_ = slot;
+        fetched_ = slot + 1;
+      }
+    }
+
+    // the next leaf in the chain is the next child of the same parent
+    void readAhead(bool scanning) {
+      if (parent_ == -1) {
+        return;
+      }
+      ++slot_;
+      if (scanning && BPT_READAHEAD > 0 && slot_ >= fetched_) {
+        fetched_ = tree_->readAheadLeaves(parent_, slot_);
+      }
+      if (fetched_ == -1) {
+        parent_ = -1;
+        fetched_ = 0;
+      }
+    }
+  };
+
+  // first entry whose key is not less than key
+  iterator lower_bound(const Key& key);
+  iterator end() { return iterator(this, -1, 0); }
+
+  // call visit(value) on the values of key in order, until it returns false
+  template <class Visitor>
+  void for_each(const Key& key, Visitor visit) {
+    for (iterator it = lower_bound(key); it != end() && it->key == key;
+         ++it) {
+      if (!visit(it->value)) {
+        return;
+      }
+    }
+  }
+
  private:
-  std::string filename_;
-  MemoryRiver<Index<Key, Value>, 2> index_file_;
-  MemoryRiver<Block<Key, Value>, 2> block_file_;
-  int root_;
-  int height_;
-  // sjtu::BPTCacheManager<Key, Value> cache_manager_;
+  using Base::block_file_;
+  using Base::cache_manager_;
+  using Base::filename_;
+  using Base::height_;
+  using Base::index_file_;
+  using Base::root_;
+  using Base::balanceLeaf;
+  using Base::buildIndex;
+  using Base::findLeafNode;
+  using Base::insertIntoParent;
+  using Base::leftmostLeaf;
+  using Base::saveRoot;
+  using Base::swapFiles;
+
+  bool defer_merges_{false};
+
+  // files a rebuild replaces together
+  static constexpr const char* FILES[] = {".index", ".block"};
+
+  // descend to the leftmost leaf that may hold key, without copying nodes
+  int descend(const Key& key);
+  // the same, also telling the index node above the leaf and its slot
+  // there; parent is -1 when the root is a leaf
+  int descend(const Key& key, int& parent, int& slot);
 
-  // search for target leafnode and record the search path
-  int findLeafNode(const Key_Value<Key, Value>& key,
-                   sjtu::vector<pathFrame<Key, Value>>& path);
+  // descend to the leaf that holds entry, also telling its parent and slot
+  int descendTo(const Key_Value<Key, Value>& entry, int& parent, int& slot);
 
-  int findLeafNode(const Key& key, sjtu::vector<pathFrame<Key, Value>>& path);
+  // read the children of parent from slot on, at most BPT_READAHEAD of
+  // them, into the buffer pool; returns the first slot not read, or -1 if
+  // slot is past the last child
+  int readAheadLeaves(int parent, int slot);
+
+  // find the leaf that key falls into without copying nodes; bound is set
+  // to the nearest separator right of that leaf, when there is one
+  int findLeafBound(const Key_Value<Key, Value>& key,
+                    Separator<Key, Value>& bound, bool& bounded);
 
   // insert key-value pair and return true if need split
   bool insertIntoLeaf(int leaf_addr, const Key& key, const Value& value,
-                      Key_Value<Key, Value>& split_key, int& new_leaf_addr);
+                      Separator<Key, Value>& split_key, int& new_leaf_addr);
 
   // handle split logic
-  bool splitLeaf(Block<Key, Value>& leaf, int leaf_addr,
-                 Key_Value<Key, Value>& split_key, int& new_leaf_addr);
-
-  // pass the split information to parent node
-  bool insertIntoParent(const sjtu::vector<pathFrame<Key, Value>>& path,
-                        int level, const Key_Value<Key, Value>& key,
-                        int right_child);
-
-  // split index node
-  bool splitInternal(Index<Key, Value>& node, int node_addr,
-                     Key_Value<Key, Value>& split_key, int& new_node_addr);
+  bool splitLeaf(int leaf_addr, Separator<Key, Value>& split_key,
+                 int& new_leaf_addr);
 
-  // balance block by borrowing from siblings or merge
-  void balanceAfterRemove(Block<Key, Value>& node, int node_addr,
-                          sjtu::vector<pathFrame<Key, Value>>& path);
+  // merge batch[from, to), which all fall into one leaf, into that leaf
+  void mergeIntoLeaf(int leaf_addr,
+                     const sjtu::vector<Key_Value<Key, Value>>& batch,
+                     size_t from, size_t to);
 
-  // adjust parent index after block merging
-  void removeFromParent(Index<Key, Value>& parent, int parent_addr, int key_idx,
-                        sjtu::vector<pathFrame<Key, Value>>& path);
+  // write total entries, produced in ascending order by next(), into fresh
+  // files and swap them in for the current ones. The files are written
+  // around the buffer pool and the log, so only compact, which runs between
+  // two checkpoints, may call it.
+  template <class Source>
+  void rebuild(size_t total, Source next);
 
-  // adjust parent index after index merging
-  void balanceInternalNode(Index<Key, Value>& node, int node_addr,
-                           sjtu::vector<pathFrame<Key, Value>>& path);
+  // leaf layout, for balanceLeaf
+  static void moveEntry(BlockNode& to, int i, const BlockNode& from, int j) {
+    to.data[i] = from.data[j];
+  }
+  static Separator<Key, Value> firstSeparator(const BlockNode& leaf) {
+    return separatorOf(leaf.data[0]);
+  }
 };
\ No newline at end of file
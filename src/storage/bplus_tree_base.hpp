@@ -0,0 +1,469 @@
+#pragma once
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "../stl/vector.hpp"
+#include "cache.hpp"
+#include "index_block.hpp"
+#include "river.hpp"
+#include "wal.hpp"
+
+template <class IndexNode>
+struct pathFrame {
+  IndexNode index;
+  int index_addr;
+  int pos;
+};
+
+// Node searches are branchless: the range halves on every step whatever
+// the comparison says, so the loop has no mispredicted jumps, and each
+// probe is a single three-way comparison of the keys.
+
+// first slot in [left, right] whose key is not less than key, or right + 1
+template <class Key, class Value>
+int binarySearch(const Key_Value<Key, Value>* array, const Key& key,
+                 int left, int right) {
+  int base = left;
+  for (int n = right - left + 1; n > 1; n -= n / 2) {
+    base = compareKeys(array[base + n / 2].key, key) < 0 ? base + n / 2
+                                                         : base;
+  }
+  return compareKeys(array[base].key, key) < 0 ? base + 1 : base;
+}
+
+template <class Key>
+int binarySearch(const Key* array, const Key& key, int left, int right) {
+  int base = left;
+  for (int n = right - left + 1; n > 1; n -= n / 2) {
+    base = compareKeys(array[base + n / 2], key) < 0 ? base + n / 2 : base;
+  }
+  return compareKeys(array[base], key) < 0 ? base + 1 : base;
+}
+
+// first slot in [left, right] whose key is greater than key, or right + 1
+template <class Key>
+int binarySearchForBigOrEqual(const Key* array, const Key& key, int left,
+                              int right) {
+  int base = left;
+  for (int n = right - left + 1; n > 1; n -= n / 2) {
+    base = compareKeys(array[base + n / 2], key) <= 0 ? base + n / 2 : base;
+  }
+  return compareKeys(array[base], key) <= 0 ? base + 1 : base;
+}
+
+template <class Key, class Value>
+int binarySearchForBigOrEqual(const Key_Value<Key, Value>* array,
+                              const Key& key, int left, int right) {
+  int base = left;
+  for (int n = right - left + 1; n > 1; n -= n / 2) {
+    base = compareKeys(array[base + n / 2].key, key) <= 0 ? base + n / 2
+                                                          : base;
+  }
+  return compareKeys(array[base].key, key) <= 0 ? base + 1 : base;
+}
+
+// Files, root and internal nodes of BPT and UniqueBPT. Both keep internal
+// nodes of the same shape: size keys of type SepKey and size + 1 children,
+// keys[i] being the smallest separator below children[i + 1]. Splitting,
+// borrowing and merging them is done here once; the trees only handle
+// their own leaves and pass the path of index nodes they descended.
+template <class IndexNode, class BlockNode, class SepKey, size_t ORDER>
+class BPTBase {
+ protected:
+  using PathFrame = pathFrame<IndexNode>;
+  // nodes start on page boundaries of their files
+  using IndexRiver = River<IndexNode, 2, NODE_PAGE_SIZE>;
+  using BlockRiver = River<BlockNode, 2, NODE_PAGE_SIZE>;
+
+  std::string filename_;
+  // suffixes of the files a rebuild replaces together, see swapFiles
+  const char* const* parts_;
+  int part_count_;
+  IndexRiver index_file_;
+  BlockRiver block_file_;
+  int root_;
+  int height_;
+  sjtu::BPTCacheManager<IndexNode, BlockNode, NODE_PAGE_SIZE> cache_manager_;
+  // whether the constructor created the files
+  bool created_{false};
+
+  BPTBase(const std::string& filename, const char* const* parts,
+          int part_count)
+      : filename_(filename),
+        parts_(parts),
+        part_count_(part_count),
+        index_file_(filename + ".index"),
+        block_file_(filename + ".block"),
+        cache_manager_(index_file_, block_file_) {
+    // no file has been opened yet
+    finishSwap();
+    if (!index_file_.exist()) {
+      index_file_.initialise();
+      block_file_.initialise();
+      root_ = -1;
+      height_ = 0;
+      // the zeroed header would name the header page itself as the root
+      saveRoot();
+      cache_manager_.sync();
+      created_ = true;
+    } else {
+      index_file_.get_info(root_, 1);
+      index_file_.get_info(height_, 2);
+    }
+  }
+
+  // Put the rebuilt files <part>.tmp in place of the parts. The rebuild
+  // bypasses the log, which the checkpoint before it has emptied, so the
+  // swap protects itself: the new files are synced, then an empty marker
+  // file commits the swap. A run that finds the marker finishes the
+  // renames, one that finds tmp files without it drops them.
+  void swapFiles() {
+    for (int i = 0; i < part_count_; ++i) {
+      WriteAheadLog::syncFile(filename_ + parts_[i] + ".tmp");
+    }
+    std::string marker = filename_ + ".swap";
+    std::ofstream(marker).close();
+    WriteAheadLog::syncFile(marker);
+    WriteAheadLog::syncFile(directory());
+    finishSwap();
+  }
+
+  void finishSwap() {
+    std::string marker = filename_ + ".swap";
+    bool committed = std::filesystem::exists(marker);
+    for (int i = 0; i < part_count_; ++i) {
+      std::string part = filename_ + parts_[i];
+      if (!std::filesystem::exists(part + ".tmp")) {
+        continue;
+      }
+      if (committed) {
+        std::filesystem::rename(part + ".tmp", part);
+      } else {
+        std::filesystem::remove(part + ".tmp");
+      }
+    }
+    if (committed) {
+      // the renames must be on disk before the marker goes
+      WriteAheadLog::syncFile(directory());
+      std::filesystem::remove(marker);
+      WriteAheadLog::syncFile(directory());
+    }
+  }
+
+  std::string directory() const {
+    std::string dir = std::filesystem::path(filename_).parent_path().string();
+    return dir.empty() ? "." : dir;
+  }
+
+  // record root_ and height_ in the index header, through the buffer pool
+  void saveRoot() {
+    cache_manager_.write_index_info(root_, 1);
+    cache_manager_.write_index_info(height_, 2);
+  }
+
+  // first leaf of the chain, or -1
+  int leftmostLeaf() {
+    int ptr = root_;
+    for (int level = 1; ptr != -1 && level <= height_; level++) {
+      const IndexNode& node = cache_manager_.pin_index(ptr);
+      int next = node.children[0];
+      cache_manager_.unpin_index(ptr);
+      ptr = next;
+    }
+    return ptr;
+  }
+
+  // search for target leafnode and record the search path; probe is a
+  // SepKey, or anything the node search compares against one
+  template <class Probe>
+  int findLeafNode(const Probe& probe, sjtu::vector<PathFrame>& path) {
+    int ptr = root_;
+    path.clear();
+    if (ptr == -1) {
+      return -1;
+    }
+    for (int level = 1; level <= height_; level++) {
+      IndexNode node;
+      cache_manager_.read_index(node, ptr);
+      int idx = (node.size == 0) ? 0
+                                 : binarySearchForBigOrEqual(node.keys, probe,
+                                                             0, node.size - 1);
+      path.push_back({node, ptr, idx});
+      ptr = node.children[idx];
+    }
+    return ptr;
+  }
+
+  // pass the split information to parent node
+  void insertIntoParent(const sjtu::vector<PathFrame>& path, int level,
+                        const SepKey& key, int right_child) {
+    if (level < 0) {
+      IndexNode new_root;
+      new_root.size = 1;
+      new_root.keys[0] = key;
+      new_root.children[0] = path.empty() ? root_ : path[0].index_addr;
+      new_root.children[1] = right_child;
+      root_ = cache_manager_.write_index(new_root);
+      height_++;
+      saveRoot();
+      return;
+    }
+    auto [parent, parent_addr, child_idx] = path[level];
+
+    for (int i = parent.size; i > child_idx; --i) {
+      parent.keys[i] = parent.keys[i - 1];
+      parent.children[i + 1] = parent.children[i];
+    }
+    parent.keys[child_idx] = key;
+    parent.children[child_idx + 1] = right_child;
+    parent.size++;
+    if (parent.size < ORDER) {
+      cache_manager_.update_index(parent, parent_addr);
+      return;
+    }
+
+    SepKey new_split_key;
+    int new_index_addr;
+    splitInternal(parent, parent_addr, new_split_key, new_index_addr);
+    insertIntoParent(path, level - 1, new_split_key, new_index_addr);
+  }
+
+  // split index node
+  void splitInternal(IndexNode& node, int node_addr, SepKey& split_key,
+                     int& new_node_addr) {
+    IndexNode new_node;
+    int split_pos = ORDER / 2;
+    new_node.size = ORDER - split_pos - 1;
+    for (int i = 0; i < new_node.size; ++i) {
+      new_node.keys[i] = node.keys[i + split_pos + 1];
+      new_node.children[i] = node.children[i + split_pos + 1];
+    }
+    new_node.children[new_node.size] = node.children[ORDER];
+    split_key = node.keys[split_pos];
+    node.size = split_pos;
+    cache_manager_.update_index(node, node_addr);
+    new_node_addr = cache_manager_.write_index(new_node);
+  }
+
+  // adjust parent index after block merging
+  void removeFromParent(IndexNode& parent, int parent_addr, int key_idx,
+                        sjtu::vector<PathFrame>& path) {
+    for (int i = key_idx; i < parent.size - 1; ++i) {
+      parent.keys[i] = parent.keys[i + 1];
+    }
+    for (int i = key_idx + 1; i < parent.size; ++i) {
+      parent.children[i] = parent.children[i + 1];
+    }
+    parent.size--;
+    if (path.empty() && parent.size == 0) {
+      cache_manager_.free_index(parent_addr);
+      root_ = parent.children[0];
+      height_--;
+      saveRoot();
+      return;
+    }
+    if (path.empty() || parent.size >= ORDER / 3) {
+      cache_manager_.update_index(parent, parent_addr);
+      return;
+    }
+    balanceInternalNode(parent, parent_addr, path);
+  }
+
+  // Write the index levels above a chain of leaves into index, bottom-up
+  // until one node is left. addrs are the leaves in key order and
+  // first_keys the separators of their first entries; root and height
+  // describe the finished tree, -1 and 0 when there is no leaf.
+  static void buildIndex(IndexRiver& index, sjtu::vector<SepKey> first_keys,
+                         sjtu::vector<int> addrs, int& root, int& height) {
+    height = 0;
+    while (addrs.size() > 1) {
+      sjtu::vector<SepKey> upper_keys;
+      sjtu::vector<int> upper_addrs;
+      size_t n = addrs.size();
+      size_t node_count = (n + ORDER - 1) / ORDER;
+      size_t pos = 0;
+      for (size_t i = 0; i < node_count; ++i) {
+        size_t count = n / node_count + (i < n % node_count ? 1 : 0);
+        IndexNode node;
+        node.size = count - 1;
+        for (size_t j = 0; j < count; ++j) {
+          node.children[j] = addrs[pos + j];
+          if (j > 0) {
+            node.keys[j - 1] = first_keys[pos + j];
+          }
+        }
+        upper_keys.push_back(first_keys[pos]);
+        upper_addrs.push_back(index.write(node));
+        pos += count;
+      }
+      first_keys = upper_keys;
+      addrs = upper_addrs;
+      height++;
+    }
+    root = addrs.empty() ? -1 : addrs[0];
+  }
+
+  // Balance a leaf left with fewer than a third of leaf_size entries, by
+  // borrowing from a sibling or merging with one. The trees lay out their
+  // leaves differently, so move(to, i, from, j) copies entry j of from to
+  // slot i of to, and first(leaf) is the separator of its first entry.
+  template <class Move, class First>
+  void balanceLeaf(BlockNode& node, int node_addr,
+                   sjtu::vector<PathFrame>& path, size_t leaf_size, Move move,
+                   First first) {
+    if (path.empty()) {
+      if (node.size == 0) {
+        cache_manager_.free_block(node_addr);
+        root_ = -1;
+        height_ = 0;
+        saveRoot();
+      } else {
+        cache_manager_.update_block(node, node_addr);
+      }
+      return;
+    }
+    auto [parent, parent_addr, child_idx] = path.back();
+    path.pop_back();
+    BlockNode left_sibling;
+    int left_sibling_addr;
+    if (child_idx >= 1) {
+      left_sibling_addr = parent.children[child_idx - 1];
+      cache_manager_.read_block(left_sibling, left_sibling_addr);
+      if (left_sibling.size > (leaf_size + 1) / 2) {
+        for (int i = node.size; i >= 1; --i) {
+          move(node, i, node, i - 1);
+        }
+        move(node, 0, left_sibling, left_sibling.size - 1);
+        node.size++;
+        left_sibling.size--;
+        parent.keys[child_idx - 1] = first(node);
+        cache_manager_.update_block(node, node_addr);
+        cache_manager_.update_block(left_sibling, left_sibling_addr);
+        cache_manager_.update_index(parent, parent_addr);
+        return;
+      }
+    }
+    BlockNode right_sibling;
+    int right_sibling_addr;
+    if (child_idx <= parent.size - 1) {
+      right_sibling_addr = parent.children[child_idx + 1];
+      cache_manager_.read_block(right_sibling, right_sibling_addr);
+      if (right_sibling.size > (leaf_size + 1) / 2) {
+        move(node, node.size, right_sibling, 0);
+        for (int i = 0; i <= static_cast<int>(right_sibling.size) - 2; ++i) {
+          move(right_sibling, i, right_sibling, i + 1);
+        }
+        node.size++;
+        right_sibling.size--;
+        parent.keys[child_idx] = first(right_sibling);
+        cache_manager_.update_block(node, node_addr);
+        cache_manager_.update_block(right_sibling, right_sibling_addr);
+        cache_manager_.update_index(parent, parent_addr);
+        return;
+      }
+    }
+
+    if (child_idx >= 1) {
+      for (int i = 0; i < node.size; ++i) {
+        move(left_sibling, left_sibling.size + i, node, i);
+      }
+      left_sibling.size += node.size;
+      left_sibling.next = node.next;
+      cache_manager_.update_block(left_sibling, left_sibling_addr);
+      cache_manager_.free_block(node_addr);
+      removeFromParent(parent, parent_addr, child_idx - 1, path);
+    } else if (child_idx <= parent.size - 1) {
+      for (int i = 0; i < right_sibling.size; ++i) {
+        move(node, node.size + i, right_sibling, i);
+      }
+      node.size += right_sibling.size;
+      node.next = right_sibling.next;
+      cache_manager_.update_block(node, node_addr);
+      cache_manager_.free_block(right_sibling_addr);
+      removeFromParent(parent, parent_addr, child_idx, path);
+    }
+  }
+
+  // adjust parent index after index merging
+  void balanceInternalNode(IndexNode& node, int node_addr,
+                           sjtu::vector<PathFrame>& path) {
+    auto [parent, parent_addr, node_idx] = path.back();
+    path.pop_back();
+    IndexNode left_sibling;
+    int left_sibling_addr;
+    if (node_idx >= 1) {
+      left_sibling_addr = parent.children[node_idx - 1];
+      cache_manager_.read_index(left_sibling, left_sibling_addr);
+
+      if (left_sibling.size > ORDER / 2) {
+        for (int i = node.size; i > 0; --i) {
+          node.keys[i] = node.keys[i - 1];
+        }
+        for (int i = node.size + 1; i > 0; --i) {
+          node.children[i] = node.children[i - 1];
+        }
+        node.keys[0] = parent.keys[node_idx - 1];
+        node.children[0] = left_sibling.children[left_sibling.size];
+        parent.keys[node_idx - 1] = left_sibling.keys[left_sibling.size - 1];
+        node.size++;
+        left_sibling.size--;
+        cache_manager_.update_index(node, node_addr);
+        cache_manager_.update_index(left_sibling, left_sibling_addr);
+        cache_manager_.update_index(parent, parent_addr);
+        return;
+      }
+    }
+
+    IndexNode right_sibling;
+    int right_sibling_addr;
+    if (node_idx <= parent.size - 1) {
+      right_sibling_addr = parent.children[node_idx + 1];
+      cache_manager_.read_index(right_sibling, right_sibling_addr);
+
+      if (right_sibling.size > ORDER / 2) {
+        node.keys[node.size] = parent.keys[node_idx];
+        node.children[node.size + 1] = right_sibling.children[0];
+        parent.keys[node_idx] = right_sibling.keys[0];
+        node.size++;
+        for (int i = 0; i < right_sibling.size - 1; ++i) {
+          right_sibling.keys[i] = right_sibling.keys[i + 1];
+        }
+        for (int i = 0; i < right_sibling.size; ++i) {
+          right_sibling.children[i] = right_sibling.children[i + 1];
+        }
+        right_sibling.size--;
+        cache_manager_.update_index(node, node_addr);
+        cache_manager_.update_index(right_sibling, right_sibling_addr);
+        cache_manager_.update_index(parent, parent_addr);
+        return;
+      }
+    }
+
+    if (node_idx >= 1) {
+      left_sibling.keys[left_sibling.size] = parent.keys[node_idx - 1];
+      for (int i = 0; i < node.size; ++i) {
+        left_sibling.keys[left_sibling.size + 1 + i] = node.keys[i];
+      }
+      for (int i = 0; i <= node.size; ++i) {
+        left_sibling.children[left_sibling.size + 1 + i] = node.children[i];
+      }
+      left_sibling.size += node.size + 1;
+      cache_manager_.update_index(left_sibling, left_sibling_addr);
+      cache_manager_.free_index(node_addr);
+      removeFromParent(parent, parent_addr, node_idx - 1, path);
+    } else if (node_idx <= parent.size - 1) {
+      node.keys[node.size] = parent.keys[node_idx];
+      for (int i = 0; i < right_sibling.size; ++i) {
+        node.keys[node.size + 1 + i] = right_sibling.keys[i];
+      }
+      for (int i = 0; i <= right_sibling.size; ++i) {
+        node.children[node.size + 1 + i] = right_sibling.children[i];
+      }
+      node.size += right_sibling.size + 1;
+      cache_manager_.update_index(node, node_addr);
+      cache_manager_.free_index(right_sibling_addr);
+      removeFromParent(parent, parent_addr, node_idx, path);
+    }
+  }
+};
@@ -0,0 +1,330 @@
+#include "buffer_pool.hpp"
+
+constexpr size_t INITIAL_BUCKETS = 1024;
+
+BufferPool& BufferPool::instance() {
+  static BufferPool pool;
+  return pool;
+}
+
+BufferPool::BufferPool() : capacity_(BUFFER_POOL_CAPACITY) {
+  for (size_t i = 0; i < INITIAL_BUCKETS; ++i) {
+    buckets_.push_back(-1);
+  }
+}
+
+BufferPool::~BufferPool() {
+  flushAll();
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    delete[] frames_[i].data;
+  }
+}
+
+void BufferPool::setCapacity(size_t bytes) {
+  capacity_ = bytes;
+  evictUntil(0);
+}
+
+int BufferPool::registerFile(PageSource* source, int page_size,
+                             int header_size) {
+  WriteAheadLog::instance().trackFile(source->fileName());
+  for (size_t i = 0; i < files_.size(); ++i) {
+    if (files_[i].source == nullptr) {
+      files_[i] = FileEntry{source, page_size, header_size};
+      return i;
+    }
+  }
+  files_.push_back(FileEntry{source, page_size, header_size});
+  return files_.size() - 1;
+}
+
+void BufferPool::unregisterFile(int file_id) {
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    if (frames_[i].file_id == file_id) {
+      writeBack(frames_[i]);
+      hashRemove(i);
+      lruRemove(i);
+      releaseFrame(i);
+    }
+  }
+  files_[file_id] = FileEntry{};
+}
+
+char* BufferPool::pin(int file_id, int addr) {
+  int idx = lookup(file_id, addr);
+  if (idx != -1) {
+    ++hits_;
+  } else {
+    ++misses_;
+    idx = acquireFrame(file_id, addr);
+    files_[file_id].source->readPage(frames_[idx].data, addr);
+  }
+  Frame& frame = frames_[idx];
+  frame.pin_count++;
+  lruRemove(idx);
+  lruPushFront(idx);
+  return frame.data;
+}
+
+char* BufferPool::pinNew(int file_id, int addr) {
+  int idx = lookup(file_id, addr);
+  if (idx == -1) {
+    idx = acquireFrame(file_id, addr);
+  }
+  Frame& frame = frames_[idx];
+  frame.pin_count++;
+  lruRemove(idx);
+  lruPushFront(idx);
+  return frame.data;
+}
+
+void BufferPool::unpin(int file_id, int addr, bool dirty) {
+  int idx = lookup(file_id, addr);
+  if (idx == -1) {
+    return;
+  }
+  Frame& frame = frames_[idx];
+  if (frame.pin_count > 0) {
+    frame.pin_count--;
+  }
+  frame.dirty = frame.dirty || dirty;
+  if (dirty && !frame.uncommitted && WriteAheadLog::instance().enabled()) {
+    frame.uncommitted = true;
+    uncommitted_.push_back(idx);
+  }
+  if (used_bytes_ > capacity_) {
+    evictUntil(0);
+  }
+}
+
+void BufferPool::prefetch(int file_id, const int* addrs, int n) {
+  size_t budget = capacity_ / 2 / files_[file_id].page_size;
+  sjtu::vector<int> frame_ids;
+  sjtu::vector<int> page_addrs;
+  sjtu::vector<char*> pages;
+  for (int i = 0; i < n && pages.size() < budget; ++i) {
+    if (addrs[i] <= 0 || lookup(file_id, addrs[i]) != -1) {
+      continue;
+    }
+    ++misses_;
+    int idx = acquireFrame(file_id, addrs[i]);
+    // pinned, so that acquiring the rest cannot evict it before the read
+    frames_[idx].pin_count++;
+    frame_ids.push_back(idx);
+    page_addrs.push_back(addrs[i]);
+    pages.push_back(frames_[idx].data);
+  }
+  if (pages.empty()) {
+    return;
+  }
+  files_[file_id].source->readPages(&pages[0], &page_addrs[0], pages.size());
+  for (size_t i = 0; i < frame_ids.size(); ++i) {
+    frames_[frame_ids[i]].pin_count--;
+  }
+}
+
+void BufferPool::discard(int file_id, int addr) {
+  int idx = lookup(file_id, addr);
+  if (idx == -1) {
+    return;
+  }
+  hashRemove(idx);
+  lruRemove(idx);
+  releaseFrame(idx);
+}
+
+void BufferPool::discardFile(int file_id) {
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    if (frames_[i].file_id == file_id) {
+      hashRemove(i);
+      lruRemove(i);
+      releaseFrame(i);
+    }
+  }
+}
+
+void BufferPool::flushFile(int file_id) {
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    if (frames_[i].file_id == file_id) {
+      writeBack(frames_[i]);
+    }
+  }
+}
+
+void BufferPool::flushAll() {
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    if (frames_[i].file_id != -1) {
+      writeBack(frames_[i]);
+    }
+  }
+  for (size_t i = 0; i < files_.size(); ++i) {
+    if (files_[i].source != nullptr) {
+      files_[i].source->flush();
+    }
+  }
+}
+
+void BufferPool::commitPages(WriteAheadLog& wal) {
+  for (size_t i = 0; i < uncommitted_.size(); ++i) {
+    Frame& frame = frames_[uncommitted_[i]];
+    // the frame may have been dropped, or logged through an earlier entry
+    if (!frame.uncommitted) {
+      continue;
+    }
+    wal.logPage(files_[frame.file_id].source->fileName(), frame.addr,
+                frame.data, frame.size);
+    frame.uncommitted = false;
+  }
+  uncommitted_.clear();
+}
+
+size_t BufferPool::bucketOf(int file_id, int addr) const {
+  uint64_t h = (static_cast<uint64_t>(file_id) << 32) ^
+               static_cast<uint32_t>(addr);
+  h *= 0x9E3779B97F4A7C15ULL;
+  return (h >> 17) & (buckets_.size() - 1);
+}
+
+int BufferPool::lookup(int file_id, int addr) const {
+  int idx = buckets_[bucketOf(file_id, addr)];
+  while (idx != -1) {
+    const Frame& frame = frames_[idx];
+    if (frame.file_id == file_id && frame.addr == addr) {
+      return idx;
+    }
+    idx = frame.hash_next;
+  }
+  return -1;
+}
+
+int BufferPool::acquireFrame(int file_id, int addr) {
+  int size = addr == 0 ? files_[file_id].header_size
+                       : files_[file_id].page_size;
+  evictUntil(size);
+  int idx;
+  if (!free_frames_.empty()) {
+    idx = free_frames_.back();
+    free_frames_.pop_back();
+  } else {
+    frames_.push_back(Frame{});
+    idx = frames_.size() - 1;
+  }
+  Frame& frame = frames_[idx];
+  if (frame.size != size) {
+    delete[] frame.data;
+    frame.data = new char[size];
+    frame.size = size;
+  }
+  frame.file_id = file_id;
+  frame.addr = addr;
+  frame.pin_count = 0;
+  frame.dirty = false;
+  used_bytes_ += size;
+  frame_count_++;
+  // a rehash links every live frame, this one included
+  if (frame_count_ > buckets_.size()) {
+    rehash(buckets_.size() * 2);
+  } else {
+    hashInsert(idx);
+  }
+  lruPushFront(idx);
+  return idx;
+}
+
+void BufferPool::releaseFrame(int frame_idx) {
+  Frame& frame = frames_[frame_idx];
+  used_bytes_ -= frame.size;
+  frame_count_--;
+  frame.file_id = -1;
+  frame.addr = -1;
+  frame.pin_count = 0;
+  frame.dirty = false;
+  frame.uncommitted = false;
+  free_frames_.push_back(frame_idx);
+}
+
+void BufferPool::hashInsert(int frame_idx) {
+  Frame& frame = frames_[frame_idx];
+  size_t bucket = bucketOf(frame.file_id, frame.addr);
+  frame.hash_next = buckets_[bucket];
+  buckets_[bucket] = frame_idx;
+}
+
+void BufferPool::hashRemove(int frame_idx) {
+  Frame& frame = frames_[frame_idx];
+  size_t bucket = bucketOf(frame.file_id, frame.addr);
+  int* link = &buckets_[bucket];
+  while (*link != -1) {
+    if (*link == frame_idx) {
+      *link = frame.hash_next;
+      break;
+    }
+    link = &frames_[*link].hash_next;
+  }
+  frame.hash_next = -1;
+}
+
+void BufferPool::rehash(size_t bucket_count) {
+  buckets_.clear();
+  for (size_t i = 0; i < bucket_count; ++i) {
+    buckets_.push_back(-1);
+  }
+  for (size_t i = 0; i < frames_.size(); ++i) {
+    if (frames_[i].file_id != -1) {
+      hashInsert(i);
+    }
+  }
+}
+
+void BufferPool::lruRemove(int frame_idx) {
+  Frame& frame = frames_[frame_idx];
+  if (frame.prev != -1) {
+    frames_[frame.prev].next = frame.next;
+  } else if (lru_head_ == frame_idx) {
+    lru_head_ = frame.next;
+  }
+  if (frame.next != -1) {
+    frames_[frame.next].prev = frame.prev;
+  } else if (lru_tail_ == frame_idx) {
+    lru_tail_ = frame.prev;
+  }
+  frame.prev = frame.next = -1;
+}
+
+void BufferPool::lruPushFront(int frame_idx) {
+  Frame& frame = frames_[frame_idx];
+  frame.prev = -1;
+  frame.next = lru_head_;
+  if (lru_head_ != -1) {
+    frames_[lru_head_].prev = frame_idx;
+  }
+  lru_head_ = frame_idx;
+  if (lru_tail_ == -1) {
+    lru_tail_ = frame_idx;
+  }
+}
+
+void BufferPool::writeBack(Frame& frame) {
+  if (!frame.dirty) {
+    return;
+  }
+  WriteAheadLog::instance().syncBeforeWriteBack();
+  files_[frame.file_id].source->writePage(frame.data, frame.addr);
+  frame.dirty = false;
+  ++write_backs_;
+}
+
+void BufferPool::evictUntil(size_t incoming) {
+  int idx = lru_tail_;
+  while (idx != -1 && used_bytes_ + incoming > capacity_) {
+    int prev = frames_[idx].prev;
+    if (frames_[idx].pin_count == 0 && !frames_[idx].uncommitted) {
+      writeBack(frames_[idx]);
+      hashRemove(idx);
+      lruRemove(idx);
+      releaseFrame(idx);
+      ++evictions_;
+    }
+    idx = prev;
+  }
+}
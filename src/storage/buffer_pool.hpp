@@ -0,0 +1,131 @@
+#ifndef BPT_BUFFER_POOL_HPP
+#define BPT_BUFFER_POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "../stl/vector.hpp"
+#include "wal.hpp"
+
+// Memory budget of the shared pool in bytes, override with
+// -DBUFFER_POOL_CAPACITY=... or BufferPool::setCapacity at runtime.
+#ifndef BUFFER_POOL_CAPACITY
+#define BUFFER_POOL_CAPACITY (16u << 20)
+#endif
+
+// Backing store of one pooled file. Every page of a file has the same size,
+// except the header page at offset 0.
+class PageSource {
+ public:
+  virtual void readPage(char* page, int addr) = 0;
+  virtual void writePage(const char* page, int addr) = 0;
+  // read n pages at once, pages[i] from addrs[i]
+  virtual void readPages(char* const* pages, const int* addrs, int n) {
+    for (int i = 0; i < n; ++i) {
+      readPage(pages[i], addrs[i]);
+    }
+  }
+  // hand buffered writes to the kernel
+  virtual void flush() = 0;
+  virtual const std::string& fileName() const = 0;
+  virtual ~PageSource() {}
+};
+
+// A single page cache shared by every B+ tree in the process. Pages are
+// identified by (file id, byte offset), replaced in LRU order and written
+// back only when a dirty page is evicted or its file is flushed. While the
+// write-ahead log is enabled, pages dirtied by the running command stay in
+// memory until commitPages has logged them.
+class BufferPool {
+ public:
+  static BufferPool& instance();
+
+  void setCapacity(size_t bytes);
+  size_t capacity() const { return capacity_; }
+  size_t usedBytes() const { return used_bytes_; }
+
+  int registerFile(PageSource* source, int page_size, int header_size);
+  // write back and drop every page of the file
+  void unregisterFile(int file_id);
+
+  // pin a page, reading it from its file on a miss
+  char* pin(int file_id, int addr);
+  // pin a page that has just been allocated, without reading it
+  char* pinNew(int file_id, int addr);
+  void unpin(int file_id, int addr, bool dirty);
+  // read the missing ones of n record pages in one batch, so that pinning
+  // them afterwards hits; only as many as fit in half the pool are read
+  void prefetch(int file_id, const int* addrs, int n);
+  // drop a page without writing it back
+  void discard(int file_id, int addr);
+  // drop every page of the file without writing it back
+  void discardFile(int file_id);
+
+  void flushFile(int file_id);
+  // write back every dirty page and flush every file
+  void flushAll();
+
+  // log the pages dirtied since the last commit
+  void commitPages(WriteAheadLog& wal);
+
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+  size_t evictions() const { return evictions_; }
+  size_t writeBacks() const { return write_backs_; }
+
+ private:
+  struct Frame {
+    int file_id{-1};
+    int addr{-1};
+    int pin_count{0};
+    bool dirty{false};
+    bool uncommitted{false};  // dirtied by the running command
+    char* data{nullptr};
+    int size{0};
+    int prev{-1};  // LRU list, head is the most recently used
+    int next{-1};
+    int hash_next{-1};
+  };
+
+  struct FileEntry {
+    PageSource* source{nullptr};
+    int page_size{0};
+    int header_size{0};
+  };
+
+  size_t capacity_;
+  size_t used_bytes_{0};
+  sjtu::vector<Frame> frames_;
+  sjtu::vector<int> free_frames_;
+  sjtu::vector<int> buckets_;
+  sjtu::vector<FileEntry> files_;
+  sjtu::vector<int> uncommitted_;
+  size_t frame_count_{0};
+  int lru_head_{-1};
+  int lru_tail_{-1};
+
+  size_t hits_{0};
+  size_t misses_{0};
+  size_t evictions_{0};
+  size_t write_backs_{0};
+
+  BufferPool();
+  ~BufferPool();
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  size_t bucketOf(int file_id, int addr) const;
+  int lookup(int file_id, int addr) const;
+  int acquireFrame(int file_id, int addr);
+  void releaseFrame(int frame_idx);
+  void hashInsert(int frame_idx);
+  void hashRemove(int frame_idx);
+  void rehash(size_t bucket_count);
+  void lruRemove(int frame_idx);
+  void lruPushFront(int frame_idx);
+  void writeBack(Frame& frame);
+  void evictUntil(size_t incoming);
+};
+
+#endif  // BPT_BUFFER_POOL_HPP
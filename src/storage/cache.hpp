@@ -3,11 +3,25 @@
 #define BPT_CACHE_HPP
 
 #include <functional>
+#include <new>
 
 #include "../stl/hash_map.hpp"
 #include "../stl/list.hpp"
+#include "buffer_pool.hpp"
 #include "index_block.hpp"
-#include "memory_river.hpp"
+#include "river.hpp"
+
+// Keep a copy of every internal B+ tree node in memory once it has been
+// read, so descents only go to the buffer pool for leaves; 0 turns it off.
+#ifndef BPT_RESIDENT_INDEX
+#define BPT_RESIDENT_INDEX 1
+#endif
+
+// Memory budget of each tree's resident internal nodes in bytes, override
+// with -DBPT_RESIDENT_BYTES=...
+#ifndef BPT_RESIDENT_BYTES
+#define BPT_RESIDENT_BYTES (1u << 20)
+#endif
 
 namespace sjtu {
 
@@ -164,95 +178,409 @@ class LRUCache {
   }
 };
 
-template <class Key, class Value>
+// Adapts a river to the page interface of the shared BufferPool. The page
+// at offset 0 is the river's header.
+template <class RiverType, class T>
+class RiverPageSource : public PageSource {
+ private:
+  RiverType& river_;
+
+ public:
+  explicit RiverPageSource(RiverType& river) : river_(river) {}
+
+  void readPage(char* page, int addr) override {
+    if (addr == 0) {
+      river_.read_header(page);
+    } else {
+      river_.read(*reinterpret_cast<T*>(page), addr);
+    }
+  }
+
+  void writePage(const char* page, int addr) override {
+    if (addr == 0) {
+      river_.write_header(page);
+    } else {
+      river_.update(*reinterpret_cast<T*>(const_cast<char*>(page)), addr);
+    }
+  }
+
+  void readPages(char* const* pages, const int* addrs, int n) override {
+    river_.read_batch(reinterpret_cast<T* const*>(pages), addrs, n);
+  }
+
+  void flush() override { river_.flush(); }
+
+  const std::string& fileName() const override { return river_.name(); }
+};
+
+// One river seen through the shared BufferPool. A memory mapped river is
+// already its own cache, so its records are used in place instead.
+// Through the pool even the header and the free list links are pages, so
+// every change to the file is deferred and logged the same way.
+template <class T, int info_len = 2, int align = 1>
+class PagedFile {
+ private:
+  using RiverType = River<T, info_len, align>;
+
+  RiverType& river_;
+  RiverPageSource<RiverType, T> source_;
+  BufferPool& pool_;
+  int id_{-1};
+
+  int* pin_header() { return reinterpret_cast<int*>(pool_.pin(id_, 0)); }
+
+  void unpin_header(bool dirty) { pool_.unpin(id_, 0, dirty); }
+
+  // pop the free list, or extend the file
+  int allocate() {
+    int* header = pin_header();
+    int addr = header[info_len];
+    if (addr == 0) {
+      unpin_header(false);
+      return river_.allocate();
+    }
+    header[info_len] = *reinterpret_cast<const int*>(pool_.pin(id_, addr));
+    pool_.unpin(id_, addr, false);
+    unpin_header(true);
+    return addr;
+  }
+
+ public:
+  explicit PagedFile(RiverType& river)
+      : river_(river), source_(river), pool_(BufferPool::instance()) {
+    if constexpr (!RiverType::is_mapped) {
+      id_ = pool_.registerFile(&source_, sizeof(T), RiverType::header_size);
+    }
+  }
+
+  ~PagedFile() {
+    if constexpr (!RiverType::is_mapped) {
+      pool_.unregisterFile(id_);
+    }
+  }
+
+  PagedFile(const PagedFile&) = delete;
+  PagedFile& operator=(const PagedFile&) = delete;
+
+  void get_info(int& tmp, int n) {
+    if constexpr (RiverType::is_mapped) {
+      river_.get_info(tmp, n);
+    } else {
+      tmp = pin_header()[n - 1];
+      unpin_header(false);
+    }
+  }
+
+  void write_info(int tmp, int n) {
+    if constexpr (RiverType::is_mapped) {
+      river_.write_info(tmp, n);
+    } else {
+      pin_header()[n - 1] = tmp;
+      unpin_header(true);
+    }
+  }
+
+  // the reference stays valid until unpin; no write may happen meanwhile
+  const T& pin(int addr) {
+    if constexpr (RiverType::is_mapped) {
+      return river_.at(addr);
+    } else {
+      return *reinterpret_cast<T*>(pool_.pin(id_, addr));
+    }
+  }
+
+  // like pin, but the record may be changed in place; pass dirty to unpin
+  // if it was. No write may happen meanwhile either, as a memory mapped
+  // file may move when it grows.
+  T& pin_for_write(int addr) {
+    if constexpr (RiverType::is_mapped) {
+      return river_.at(addr);
+    } else {
+      return *reinterpret_cast<T*>(pool_.pin(id_, addr));
+    }
+  }
+
+  // load records that are about to be read, in one batch
+  void prefetch(const int* addrs, int n) {
+    if constexpr (!RiverType::is_mapped) {
+      pool_.prefetch(id_, addrs, n);
+    }
+  }
+
+  void unpin(int addr, bool dirty = false) {
+    if constexpr (!RiverType::is_mapped) {
+      pool_.unpin(id_, addr, dirty);
+    }
+  }
+
+  void read(T& t, int addr) {
+    t = pin(addr);
+    unpin(addr);
+  }
+
+  int write(const T& t) {
+    if constexpr (RiverType::is_mapped) {
+      return river_.write(const_cast<T&>(t));
+    } else {
+      int addr = allocate();
+      *reinterpret_cast<T*>(pool_.pinNew(id_, addr)) = t;
+      pool_.unpin(id_, addr, true);
+      return addr;
+    }
+  }
+
+  void update(const T& t, int addr) {
+    if constexpr (RiverType::is_mapped) {
+      river_.at(addr) = t;
+    } else {
+      *reinterpret_cast<T*>(pool_.pinNew(id_, addr)) = t;
+      pool_.unpin(id_, addr, true);
+    }
+  }
+
+  // give the record's slot back to the free list
+  void free(int addr) {
+    if constexpr (RiverType::is_mapped) {
+      river_.Delete(addr);
+    } else {
+      int* header = pin_header();
+      *reinterpret_cast<int*>(pool_.pinNew(id_, addr)) = header[info_len];
+      header[info_len] = addr;
+      pool_.unpin(id_, addr, true);
+      unpin_header(true);
+    }
+  }
+
+  void flush() {
+    if constexpr (RiverType::is_mapped) {
+      river_.flush();
+    } else {
+      pool_.flushFile(id_);
+    }
+  }
+
+  // write the file's pages back and sync it, for a file that was just
+  // created: until the first log sync, nothing else would put its first
+  // pages on disk
+  void sync() {
+    flush();
+    river_.flush();
+    WriteAheadLog::syncFile(river_.name());
+  }
+
+  // forget every cached page and close the river, e.g. before its file is
+  // replaced on disk; the river reopens lazily on next access
+  void reset() {
+    if constexpr (!RiverType::is_mapped) {
+      pool_.discardFile(id_);
+    }
+    river_.close();
+  }
+};
+
+// Per-tree view of the shared BufferPool. Nodes are copied in and out of
+// pooled pages, or pinned in place when the caller only reads them.
+// Internal nodes are also kept resident (BPT_RESIDENT_INDEX): the copies
+// sit in one arena of BPT_RESIDENT_BYTES, are written through to the pool
+// on every change, and serve every later read without touching the pool.
+// Once the arena is full, further nodes are read from the pool as leaves
+// are; descents reach the upper levels first, so those are the ones kept.
+// A memory mapped index is already resident, so it never keeps copies.
+template <class IndexNode, class BlockNode, int align = 1>
 class BPTCacheManager {
  private:
-  LRUCache<int, Index<Key, Value>> index_cache_;
-  LRUCache<int, Block<Key, Value>> block_cache_;
+  using IndexRiver = River<IndexNode, 2, align>;
+  static constexpr bool keeps_index =
+      BPT_RESIDENT_INDEX && !IndexRiver::is_mapped;
+
+  PagedFile<IndexNode, 2, align> index_file_;
+  PagedFile<BlockNode, 2, align> block_file_;
+
+  // room for capacity_ copies, of which the first used_ have been handed
+  // out; allocated on first use, so only the pages in use are touched
+  IndexNode* arena_{nullptr};
+  size_t capacity_;
+  size_t used_{0};
+  // arena entry of each slot, -1 where the node is not kept
+  sjtu::vector<int> resident_;
+  // entries given back by free_index
+  sjtu::vector<int> spare_;
+  size_t resident_hits_{0};
+  size_t resident_loads_{0};
+
+  static size_t slotOf(int index_addr) {
+    return (index_addr - IndexRiver::data_offset) / IndexRiver::stride;
+  }
 
-  MemoryRiver<Index<Key, Value>, 2>& index_file_;
-  MemoryRiver<Block<Key, Value>, 2>& block_file_;
+  IndexNode* resident(int index_addr) {
+    size_t slot = slotOf(index_addr);
+    return slot < resident_.size() && resident_[slot] != -1
+               ? arena_ + resident_[slot]
+               : nullptr;
+  }
+
+  // refresh the copy of the node, or make one while the arena has room
+  void keep(const IndexNode& index, int index_addr) {
+    IndexNode* node = resident(index_addr);
+    if (node != nullptr) {
+      *node = index;
+      return;
+    }
+    int entry;
+    if (!spare_.empty()) {
+      entry = spare_[spare_.size() - 1];
+      spare_.pop_back();
+    } else if (used_ < capacity_) {
+      if (arena_ == nullptr) {
+        arena_ = static_cast<IndexNode*>(
+            ::operator new(capacity_ * sizeof(IndexNode)));
+      }
+      entry = static_cast<int>(used_++);
+    } else {
+      return;
+    }
+    size_t slot = slotOf(index_addr);
+    while (resident_.size() <= slot) {
+      resident_.push_back(-1);
+    }
+    new (arena_ + entry) IndexNode(index);
+    resident_[slot] = entry;
+  }
+
+  void dropResident() {
+    resident_.clear();
+    spare_.clear();
+    used_ = 0;
+  }
 
  public:
-  BPTCacheManager(MemoryRiver<Index<Key, Value>, 2>& index_file,
-                  MemoryRiver<Block<Key, Value>, 2>& block_file,
-                  size_t index_cache_size = 5, size_t block_cache_size = 5)
+  BPTCacheManager(IndexRiver& index_file,
+                  River<BlockNode, 2, align>& block_file)
       : index_file_(index_file),
         block_file_(block_file),
-        index_cache_(index_cache_size),
-        block_cache_(block_cache_size) {
-    index_cache_.set_eviction_callback(
-        [this](int addr, const Index<Key, Value>& index) {
-          if (index_cache_.is_dirty(addr)) {
-            index_file_.update(const_cast<Index<Key, Value>&>(index), addr);
-          }
-        });
-
-    block_cache_.set_eviction_callback(
-        [this](int addr, const Block<Key, Value>& block) {
-          if (block_cache_.is_dirty(addr)) {
-            block_file_.update(const_cast<Block<Key, Value>&>(block), addr);
-          }
-        });
-  }
-
-  void read_index(Index<Key, Value>& index, int index_addr) {
-    if (index_cache_.contains(index_addr)) {
-      index = index_cache_.get(index_addr);
-      return;
+        capacity_(BPT_RESIDENT_BYTES / sizeof(IndexNode)) {}
+
+  // nodes hold no resources, so the arena goes without destroying them
+  ~BPTCacheManager() { ::operator delete(arena_); }
+
+  BPTCacheManager(const BPTCacheManager&) = delete;
+  BPTCacheManager& operator=(const BPTCacheManager&) = delete;
+
+  const IndexNode& pin_index(int index_addr) {
+    if constexpr (keeps_index) {
+      IndexNode* node = resident(index_addr);
+      if (node != nullptr) {
+        resident_hits_++;
+        return *node;
+      }
+      const IndexNode& page = index_file_.pin(index_addr);
+      keep(page, index_addr);
+      node = resident(index_addr);
+      if (node == nullptr) {
+        // the arena is full, so the page stays pinned until unpin_index
+        return page;
+      }
+      resident_loads_++;
+      index_file_.unpin(index_addr);
+      return *node;
+    } else {
+      return index_file_.pin(index_addr);
     }
-    index_file_.read(index, index_addr);
-    index_cache_.put(index_addr, index, false);
   }
 
-  void read_block(Block<Key, Value>& block, int block_addr) {
-    if (block_cache_.contains(block_addr)) {
-      block = block_cache_.get(block_addr);
-      return;
+  void unpin_index(int index_addr) {
+    if (!keeps_index || resident(index_addr) == nullptr) {
+      index_file_.unpin(index_addr);
     }
+  }
+
+  const BlockNode& pin_block(int block_addr) {
+    return block_file_.pin(block_addr);
+  }
+
+  // change a leaf in place instead of copying it out and back in
+  BlockNode& pin_block_for_write(int block_addr) {
+    return block_file_.pin_for_write(block_addr);
+  }
+
+  // read leaves that are about to be visited in one batch
+  void prefetch_blocks(const int* block_addrs, int n) {
+    block_file_.prefetch(block_addrs, n);
+  }
+
+  void unpin_block(int block_addr, bool dirty = false) {
+    block_file_.unpin(block_addr, dirty);
+  }
+
+  void read_index(IndexNode& index, int index_addr) {
+    index = pin_index(index_addr);
+    unpin_index(index_addr);
+  }
+
+  void read_block(BlockNode& block, int block_addr) {
     block_file_.read(block, block_addr);
-    block_cache_.put(block_addr, block, false);
   }
 
-  int write_index(const Index<Key, Value>& index) {
-    int index_addr = index_file_.write(const_cast<Index<Key, Value>&>(index));
-    index_cache_.put(index_addr, index, false);
+  int write_index(const IndexNode& index) {
+    int index_addr = index_file_.write(index);
+    if constexpr (keeps_index) {
+      keep(index, index_addr);
+    }
     return index_addr;
   }
 
-  int write_block(const Block<Key, Value>& block) {
-    int block_addr = block_file_.write(const_cast<Block<Key, Value>&>(block));
-    block_cache_.put(block_addr, block, false);
-    return block_addr;
+  int write_block(const BlockNode& block) {
+    return block_file_.write(block);
   }
 
-  void update_index(const Index<Key, Value>& index, int index_addr) {
-    index_cache_.put(index_addr, index, true);
+  void update_index(const IndexNode& index, int index_addr) {
+    index_file_.update(index, index_addr);
+    if constexpr (keeps_index) {
+      keep(index, index_addr);
+    }
   }
 
-  void update_block(const Block<Key, Value>& block, int block_addr) {
-    block_cache_.put(block_addr, block, true);
+  void update_block(const BlockNode& block, int block_addr) {
+    block_file_.update(block, block_addr);
+  }
+
+  void write_index_info(int tmp, int n) { index_file_.write_info(tmp, n); }
+
+  void write_block_info(int tmp, int n) { block_file_.write_info(tmp, n); }
+
+  void free_index(int index_addr) {
+    if constexpr (keeps_index) {
+      if (resident(index_addr) != nullptr) {
+        spare_.push_back(resident_[slotOf(index_addr)]);
+        resident_[slotOf(index_addr)] = -1;
+      }
+    }
+    index_file_.free(index_addr);
   }
 
+  void free_block(int block_addr) { block_file_.free(block_addr); }
+
   void flush_cache() {
-    index_cache_.for_each_dirty(
-        [this](int addr, const Index<Key, Value>& index) {
-          index_file_.update(const_cast<Index<Key, Value>&>(index), addr);
-          index_cache_.mark_dirty(addr, false);
-        });
+    index_file_.flush();
+    block_file_.flush();
+  }
 
-    block_cache_.for_each_dirty(
-        [this](int addr, const Block<Key, Value>& block) {
-          block_file_.update(const_cast<Block<Key, Value>&>(block), addr);
-          block_cache_.mark_dirty(addr, false);
-        });
+  // put both files of a new tree on disk, see PagedFile::sync
+  void sync() {
+    index_file_.sync();
+    block_file_.sync();
   }
 
-  void clear() {
-    flush_cache();
-    index_cache_.clear();
-    block_cache_.clear();
+  void reset() {
+    dropResident();
+    index_file_.reset();
+    block_file_.reset();
   }
+
+  // internal node reads served by resident copies, and reads that had to
+  // go to the buffer pool to fill them
+  size_t residentHits() const { return resident_hits_; }
+  size_t residentLoads() const { return resident_loads_; }
 };
 
 }  // namespace sjtu
@@ -0,0 +1,420 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "../stl/vector.hpp"
+#include "cache.hpp"
+#include "index_block.hpp"
+#include "record_codec.hpp"
+#include "river.hpp"
+#include "slotted_page.hpp"
+
+// Directory entries never exceed 2^HASH_MAX_DEPTH; past that, buckets only
+// grow overflow pages.
+#ifndef HASH_MAX_DEPTH
+#define HASH_MAX_DEPTH 20
+#endif
+
+// a page of directory entries, each the address of a bucket
+struct HashDirPage {
+  static constexpr int capacity = NODE_PAGE_SIZE / sizeof(int);
+  int buckets[capacity];
+};
+
+// Persistent extendible hash index for tables keyed by 64-bit hashes that
+// are only ever looked up by key, never in order. The low bits of a key's
+// hash select a directory entry, and the directory, kept in memory, names
+// the bucket page: a lookup reads one page.
+// A full bucket splits in two on one more hash bit, doubling the directory
+// when that bit is new to it. Keys may repeat; the values of a key are
+// visited in the order they were inserted, and a full bucket whose entries
+// the next hash bit does not part grows an overflow page instead. An entry
+// goes to the first page of its chain with room behind the values already
+// there for its key, so pages emptied by erasures fill up again.
+// Buckets are slotted pages of the raw key followed by the RecordCodec
+// encoding of the value; tag holds the local depth and next the overflow
+// page. Buckets are never merged. Both files go through the buffer pool and so
+// through the log: <filename>.hash holds the buckets, <filename>.dir the
+// directory pages, with the global depth and the entry count as its info.
+template <class Key, class Value>
+class ExtendibleHash {
+  static constexpr int max_entry = sizeof(Key) + RecordCodec<Value>::max_size;
+  static constexpr int page_size = slottedPageSize(max_entry);
+  using Bucket = SlottedPage<page_size>;
+  using BucketRiver = River<Bucket, 2, page_size>;
+  using DirRiver = River<HashDirPage, 2, NODE_PAGE_SIZE>;
+
+  // an entry between leaving a bucket and being put back
+  struct Entry {
+    char bytes[max_entry];
+    int len;
+  };
+
+ public:
+  explicit ExtendibleHash(const std::string& filename)
+      : bucket_file_(filename + ".hash"),
+        dir_file_(filename + ".dir"),
+        buckets_(bucket_file_),
+        dir_pages_(dir_file_) {
+    if (!dir_file_.exist()) {
+      bucket_file_.initialise();
+      dir_file_.initialise();
+      Bucket first{};
+      dir_.push_back(buckets_.write(first));
+      storeDir(0, 1);
+      // a directory file without its first page would send every key to
+      // the header page
+      buckets_.sync();
+      dir_pages_.sync();
+      return;
+    }
+    dir_pages_.get_info(global_depth_, 1);
+    dir_pages_.get_info(size_, 2);
+    int entries = 1 << global_depth_;
+    for (int page = 0; page * HashDirPage::capacity < entries; ++page) {
+      const HashDirPage& dir = dir_pages_.pin(dirPageAddr(page));
+      for (int i = 0; i < HashDirPage::capacity &&
+                      page * HashDirPage::capacity + i < entries;
+           ++i) {
+        dir_.push_back(dir.buckets[i]);
+      }
+      dir_pages_.unpin(dirPageAddr(page));
+      stored_pages_++;
+    }
+  }
+  ~ExtendibleHash() {
+    buckets_.flush();
+    dir_pages_.flush();
+  }
+
+  ExtendibleHash(const ExtendibleHash&) = delete;
+  ExtendibleHash& operator=(const ExtendibleHash&) = delete;
+
+  // copy the first value of key out, false if key is absent
+  bool get(const Key& key, Value& value) {
+    bool found = false;
+    for_each(key, [&](const Value& current) {
+      value = current;
+      found = true;
+      return false;
+    });
+    return found;
+  }
+
+  bool contains(const Key& key) {
+    Value value;
+    return get(key, value);
+  }
+
+  // insert a new key, false if key is already present
+  bool put(const Key& key, const Value& value) {
+    if (!addEntry(key, encode(key, value), true)) {
+      return false;
+    }
+    dir_pages_.write_info(++size_, 2);
+    return true;
+  }
+
+  // add another value under key, after those already there
+  void insert(const Key& key, const Value& value) {
+    addEntry(key, encode(key, value), false);
+    dir_pages_.write_info(++size_, 2);
+  }
+
+  // overwrite the first value of key, false if key is absent. A value that
+  // no longer fits its page moves behind the other values of key.
+  bool update(const Key& key, const Value& value) {
+    Entry entry = encode(key, value);
+    int addr = dir_[hashOf(key) & mask()];
+    while (addr != 0) {
+      Bucket& bucket = buckets_.pin_for_write(addr);
+      int slot = find(bucket, key, 0);
+      if (slot == -1) {
+        int next = bucket.next;
+        buckets_.unpin(addr);
+        addr = next;
+        continue;
+      }
+      if (!bucket.replace(slot, entry.bytes, entry.len)) {
+        bucket.eraseShift(slot);
+        buckets_.unpin(addr, true);
+        addEntry(key, entry, false);
+        return true;
+      }
+      buckets_.unpin(addr, true);
+      return true;
+    }
+    return false;
+  }
+
+  // drop the first value of key, false if key is absent
+  bool erase(const Key& key) {
+    return removeIf(key, [](const Value&) { return true; });
+  }
+
+  // drop the first value of key equal to value
+  bool remove(const Key& key, const Value& value) {
+    return removeIf(
+        key, [&value](const Value& current) { return current == value; });
+  }
+
+  bool empty() const { return size_ == 0; }
+
+  // call visit on the values of key, oldest first, until it returns false;
+  // the index must not change meanwhile
+  template <class Visitor>
+  void for_each(const Key& key, Visitor visit) {
+    Value value;
+    int addr = dir_[hashOf(key) & mask()];
+    while (addr != 0) {
+      const Bucket& bucket = buckets_.pin(addr);
+      for (int i = find(bucket, key, 0); i != -1;
+           i = find(bucket, key, i + 1)) {
+        decode(bucket, i, value);
+        if (!visit(value)) {
+          buckets_.unpin(addr);
+          return;
+        }
+      }
+      int next = bucket.next;
+      buckets_.unpin(addr);
+      addr = next;
+    }
+  }
+
+  int globalDepth() const { return global_depth_; }
+
+ private:
+  BucketRiver bucket_file_;
+  DirRiver dir_file_;
+  sjtu::PagedFile<Bucket, 2, page_size> buckets_;
+  sjtu::PagedFile<HashDirPage, 2, NODE_PAGE_SIZE> dir_pages_;
+  // bucket address of every directory entry, 2^global_depth_ of them
+  sjtu::vector<int> dir_;
+  int global_depth_{0};
+  // directory pages in the file
+  int stored_pages_{0};
+  int size_{0};
+
+  // keys may be poorly mixed in their low bits, as short usernames are
+  static uint64_t hashOf(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ULL;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBULL;
+    return key ^ (key >> 31);
+  }
+
+  uint64_t mask() const { return (uint64_t{1} << global_depth_) - 1; }
+
+  // directory pages are appended in order and never freed
+  static int dirPageAddr(int page) {
+    return DirRiver::data_offset + page * DirRiver::stride;
+  }
+
+  // write the directory pages covering entries [from, to), appending pages
+  // the directory has just grown into
+  void storeDir(int from, int to) {
+    int pages = (static_cast<int>(dir_.size()) + HashDirPage::capacity - 1) /
+                HashDirPage::capacity;
+    for (int page = from / HashDirPage::capacity;
+         page * HashDirPage::capacity < to; ++page) {
+      HashDirPage dir{};
+      for (int i = 0; i < HashDirPage::capacity &&
+                      page * HashDirPage::capacity + i <
+                          static_cast<int>(dir_.size());
+           ++i) {
+        dir.buckets[i] = dir_[page * HashDirPage::capacity + i];
+      }
+      if (page < stored_pages_) {
+        dir_pages_.update(dir, dirPageAddr(page));
+      } else {
+        dir_pages_.write(dir);
+      }
+    }
+    if (pages > stored_pages_) {
+      stored_pages_ = pages;
+    }
+    dir_pages_.write_info(global_depth_, 1);
+  }
+
+  static Entry encode(const Key& key, const Value& value) {
+    Entry entry;
+    memcpy(entry.bytes, &key, sizeof(Key));
+    RecordWriter out(entry.bytes + sizeof(Key));
+    RecordCodec<Value>::encode(value, out);
+    entry.len = sizeof(Key) + out.size();
+    return entry;
+  }
+
+  static Key keyOf(const Bucket& bucket, int slot) {
+    Key key;
+    memcpy(&key, bucket.data(slot), sizeof(Key));
+    return key;
+  }
+
+  static void decode(const Bucket& bucket, int slot, Value& value) {
+    RecordReader in(bucket.data(slot) + sizeof(Key));
+    RecordCodec<Value>::decode(in, value);
+  }
+
+  // first slot from on holding key, or -1
+  static int find(const Bucket& bucket, const Key& key, int from) {
+    for (int i = from; i < bucket.slot_count; ++i) {
+      if (keyOf(bucket, i) == key) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  template <class Pred>
+  bool removeIf(const Key& key, Pred pred) {
+    Value value;
+    int prev = 0;
+    int addr = dir_[hashOf(key) & mask()];
+    while (addr != 0) {
+      Bucket& bucket = buckets_.pin_for_write(addr);
+      int slot = find(bucket, key, 0);
+      while (slot != -1) {
+        decode(bucket, slot, value);
+        if (pred(value)) {
+          break;
+        }
+        slot = find(bucket, key, slot + 1);
+      }
+      int next = bucket.next;
+      if (slot == -1) {
+        buckets_.unpin(addr);
+        prev = addr;
+        addr = next;
+        continue;
+      }
+      // the slots after it move down, keeping the values of a key in order
+      bucket.eraseShift(slot);
+      bool drop = bucket.slot_count == 0 && prev != 0;
+      buckets_.unpin(addr, true);
+      // an emptied overflow page leaves its chain
+      if (drop) {
+        buckets_.pin_for_write(prev).next = next;
+        buckets_.unpin(prev, true);
+        buckets_.free(addr);
+      }
+      dir_pages_.write_info(--size_, 2);
+      return true;
+    }
+    return false;
+  }
+
+  // Add entry to the first page of its chain that has room and comes
+  // after every page holding key, in one walk of the chain; with unique,
+  // return false instead if key is there. A full chain splits if that parts
+  // its entries; otherwise a new page is chained, so that a few keys
+  // agreeing in many low bits cannot blow the directory up.
+  bool addEntry(const Key& key, const Entry& entry, bool unique) {
+    uint64_t hash = hashOf(key);
+    while (true) {
+      int head = dir_[hash & mask()];
+      int addr = head;
+      int last = head;
+      int target = 0;
+      // whether the next hash bit tells some of the entries apart
+      bool separable = false;
+      int local_depth = 0;
+      while (addr != 0) {
+        const Bucket& bucket = buckets_.pin(addr);
+        local_depth = bucket.tag;
+        int next = bucket.next;
+        if (find(bucket, key, 0) != -1) {
+          if (unique) {
+            buckets_.unpin(addr);
+            return false;
+          }
+          // earlier pages would put the entry before this value
+          target = 0;
+        }
+        if (target == 0 && bucket.room() >= entry.len) {
+          target = addr;
+        }
+        for (int i = 0; i < bucket.slot_count && !separable; ++i) {
+          separable = (hashOf(keyOf(bucket, i)) ^ hash) >> local_depth & 1;
+        }
+        buckets_.unpin(addr);
+        last = addr;
+        addr = next;
+      }
+      if (target != 0) {
+        buckets_.pin_for_write(target).add(entry.bytes, entry.len, false);
+        buckets_.unpin(target, true);
+        return true;
+      }
+      if (separable && local_depth < HASH_MAX_DEPTH) {
+        split(head);
+        continue;
+      }
+      Bucket page{};
+      page.tag = local_depth;
+      page.add(entry.bytes, entry.len, false);
+      int page_addr = buckets_.write(page);
+      buckets_.pin_for_write(last).next = page_addr;
+      buckets_.unpin(last, true);
+      return true;
+    }
+  }
+
+  // split the chain starting at head on the next hash bit; entries keep
+  // their order within each half
+  void split(int head) {
+    sjtu::vector<Entry> entries;
+    // every page of a chain carries the depth of its head
+    int local_depth = buckets_.pin(head).tag;
+    buckets_.unpin(head);
+    for (int addr = head; addr != 0;) {
+      const Bucket& bucket = buckets_.pin(addr);
+      for (int i = 0; i < bucket.slot_count; ++i) {
+        Entry entry;
+        entry.len = bucket.length(i);
+        memcpy(entry.bytes, bucket.data(i), entry.len);
+        entries.push_back(entry);
+      }
+      int next = bucket.next;
+      buckets_.unpin(addr);
+      if (addr != head) {
+        buckets_.free(addr);
+      }
+      addr = next;
+    }
+    if (local_depth == global_depth_) {
+      int old_size = dir_.size();
+      for (int i = 0; i < old_size; ++i) {
+        // dir_[i] would dangle once push_back reallocates
+        int bucket = dir_[i];
+        dir_.push_back(bucket);
+      }
+      global_depth_++;
+      storeDir(old_size, dir_.size());
+    }
+    Bucket low{};
+    low.tag = local_depth + 1;
+    buckets_.update(low, head);
+    int high = buckets_.write(low);
+    // the directory entries of the old bucket that have the new bit set
+    uint64_t bit = uint64_t{1} << local_depth;
+    int from = dir_.size();
+    int to = 0;
+    for (int i = 0; i < static_cast<int>(dir_.size()); ++i) {
+      if (dir_[i] == head && (i & bit)) {
+        dir_[i] = high;
+        from = i < from ? i : from;
+        to = i + 1;
+      }
+    }
+    storeDir(from, to);
+    for (size_t i = 0; i < entries.size(); ++i) {
+      Key key;
+      memcpy(&key, entries[i].bytes, sizeof(Key));
+      addEntry(key, entries[i], false);
+    }
+  }
+};
@@ -0,0 +1,277 @@
+#ifndef BPT_FILE_MEMORYRIVER_HPP
+#define BPT_FILE_MEMORYRIVER_HPP
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "io_ring.hpp"
+
+// Block size O_DIRECT transfers are aligned to.
+#ifndef DIRECT_IO_BLOCK
+#define DIRECT_IO_BLOCK 4096
+#endif
+
+// MemoryRiver with the same interface and file layout, doing positional
+// I/O with pread/pwrite on a raw descriptor: one system call per access
+// and no stream buffer in between. Built with RIVER_DIRECT_IO, files whose
+// records sit on DIRECT_IO_BLOCK boundaries are opened with O_DIRECT, so
+// pages are cached once, in the buffer pool, instead of also in the
+// kernel. read_batch issues many record reads at once through IoRing.
+template <class T, int info_len = 2, int align = 1>
+class FileMemoryRiver {
+ public:
+  static constexpr bool is_mapped = false;
+  static constexpr int header_size = (info_len + 1) * sizeof(int);
+  static constexpr int data_offset = (header_size + align - 1) / align * align;
+  static constexpr int stride = (sizeof(T) + align - 1) / align * align;
+
+ private:
+  // the header and every record cover whole blocks of their own
+  static constexpr bool block_aligned = data_offset % DIRECT_IO_BLOCK == 0 &&
+                                        stride % DIRECT_IO_BLOCK == 0;
+  // bytes moved per record with O_DIRECT
+  static constexpr size_t direct_len =
+      (sizeof(T) + DIRECT_IO_BLOCK - 1) / DIRECT_IO_BLOCK * DIRECT_IO_BLOCK;
+
+  std::string file_name;
+  int fd = -1;
+  bool direct = false;
+  // aligned staging buffer of stride bytes for O_DIRECT transfers
+  char* bounce = nullptr;
+
+  // 0 is never a record offset, so it marks an empty free list on disk
+  int free_head = -1;
+  // end of the last handed out slot, see MemoryRiver
+  int file_end = -1;
+
+  void openFile(int flags) {
+#ifdef RIVER_DIRECT_IO
+    if (block_aligned) {
+      fd = ::open(file_name.c_str(), flags | O_DIRECT, 0644);
+      // not every file system takes O_DIRECT
+      direct = fd != -1;
+    }
+#endif
+    if (fd == -1) {
+      fd = ::open(file_name.c_str(), flags, 0644);
+    }
+    if (direct && bounce == nullptr) {
+      bounce = static_cast<char*>(std::aligned_alloc(DIRECT_IO_BLOCK, stride));
+    }
+  }
+
+  void ensureFileOpen() {
+    if (fd == -1) {
+      openFile(O_RDWR | O_CREAT);
+    }
+  }
+
+  // len bytes at offset; with O_DIRECT the covering blocks are staged,
+  // and they never reach past the header or the record being accessed
+  void readAt(char* buf, size_t len, int offset) {
+    ensureFileOpen();
+    if (!direct) {
+      preadFully(fd, buf, len, offset);
+      return;
+    }
+    int start = offset / DIRECT_IO_BLOCK * DIRECT_IO_BLOCK;
+    size_t span = (offset - start + len + DIRECT_IO_BLOCK - 1) /
+                  DIRECT_IO_BLOCK * DIRECT_IO_BLOCK;
+    preadFully(fd, bounce, span, start);
+    memcpy(buf, bounce + (offset - start), len);
+  }
+
+  // whole says the bytes after len up to the block boundary are unused,
+  // so they need not be read back first
+  void writeAt(const char* buf, size_t len, int offset, bool whole) {
+    ensureFileOpen();
+    if (!direct) {
+      pwriteFully(fd, buf, len, offset);
+      return;
+    }
+    int start = offset / DIRECT_IO_BLOCK * DIRECT_IO_BLOCK;
+    size_t span = (offset - start + len + DIRECT_IO_BLOCK - 1) /
+                  DIRECT_IO_BLOCK * DIRECT_IO_BLOCK;
+    if (whole && start == offset) {
+      memset(bounce + len, 0, span - len);
+    } else {
+      preadFully(fd, bounce, span, start);
+    }
+    memcpy(bounce + (offset - start), buf, len);
+    pwriteFully(fd, bounce, span, start);
+  }
+
+  void loadFileEnd() {
+    if (file_end != -1) return;
+    ensureFileOpen();
+    struct stat st;
+    fstat(fd, &st);
+    int end = st.st_size;
+    // the last record may end short of its stride
+    int records = end <= data_offset ? 0 : (end - data_offset - 1) / stride + 1;
+    file_end = data_offset + records * stride;
+  }
+
+  void loadFreeHead() {
+    if (free_head != -1) return;
+    readAt(reinterpret_cast<char*>(&free_head), sizeof(int),
+           info_len * sizeof(int));
+  }
+
+  void storeFreeHead() {
+    writeAt(reinterpret_cast<char*>(&free_head), sizeof(int),
+            info_len * sizeof(int), false);
+  }
+
+  int popFreeSlot() {
+    loadFreeHead();
+    int index = free_head;
+    if (index == 0) return 0;
+    readAt(reinterpret_cast<char*>(&free_head), sizeof(int), index);
+    storeFreeHead();
+    return index;
+  }
+
+ public:
+  FileMemoryRiver() = default;
+
+  FileMemoryRiver(const std::string& file_name) : file_name(file_name) {}
+
+  ~FileMemoryRiver() {
+    close();
+    std::free(bounce);
+  }
+
+  FileMemoryRiver(const FileMemoryRiver&) = delete;
+  FileMemoryRiver& operator=(const FileMemoryRiver&) = delete;
+
+  FileMemoryRiver(FileMemoryRiver&& other) noexcept
+      : file_name(std::move(other.file_name)),
+        fd(other.fd),
+        direct(other.direct),
+        bounce(other.bounce),
+        free_head(other.free_head),
+        file_end(other.file_end) {
+    other.fd = -1;
+    other.bounce = nullptr;
+  }
+
+  void initialise(std::string FN = "") {
+    if (FN != "") file_name = FN;
+    close();
+    openFile(O_RDWR | O_CREAT | O_TRUNC);
+    // info_len user ints followed by the head of the free slot list
+    char header[header_size] = {};
+    writeAt(header, header_size, 0, true);
+    free_head = 0;
+    file_end = data_offset;
+  }
+
+  const std::string& name() const { return file_name; }
+
+  void get_info(int& tmp, int n) {
+    if (n > info_len) return;
+    readAt(reinterpret_cast<char*>(&tmp), sizeof(int), (n - 1) * sizeof(int));
+  }
+
+  void write_info(int tmp, int n) {
+    if (n > info_len) return;
+    writeAt(reinterpret_cast<char*>(&tmp), sizeof(int), (n - 1) * sizeof(int),
+            false);
+  }
+
+  // the whole header, for callers that keep the free list themselves
+  void read_header(char* header) { readAt(header, header_size, 0); }
+
+  void write_header(const char* header) {
+    writeAt(header, header_size, 0, true);
+    free_head = -1;
+  }
+
+  // hand out a fresh slot at the end without writing it
+  int allocate() {
+    loadFileEnd();
+    int index = file_end;
+    file_end += stride;
+    return index;
+  }
+
+  // slots handed out so far, live or free; every record address lies
+  // below data_offset + slots() * stride
+  int slots() {
+    loadFileEnd();
+    return (file_end - data_offset) / stride;
+  }
+
+  int write(T& t) {
+    ensureFileOpen();
+    int index = popFreeSlot();
+    if (index == 0) {
+      index = allocate();
+    }
+    update(t, index);
+    return index;
+  }
+
+  void update(T& t, const int index) {
+    writeAt(reinterpret_cast<char*>(&t), sizeof(T), index, true);
+  }
+
+  void read(T& t, const int index) {
+    readAt(reinterpret_cast<char*>(&t), sizeof(T), index);
+  }
+
+  // read n records at once; out[i] receives the record at indexes[i]
+  void read_batch(T* const* out, const int* indexes, int n) {
+    ensureFileOpen();
+    IoRead* reads = new IoRead[n];
+    char* staging = nullptr;
+    if (direct) {
+      staging = static_cast<char*>(
+          std::aligned_alloc(DIRECT_IO_BLOCK, direct_len * n));
+    }
+    for (int i = 0; i < n; ++i) {
+      char* buf = direct ? staging + direct_len * i
+                         : reinterpret_cast<char*>(out[i]);
+      reads[i] = IoRead{fd, buf, direct ? direct_len : sizeof(T), indexes[i]};
+    }
+    IoRing::instance().read(reads, n);
+    if (direct) {
+      for (int i = 0; i < n; ++i) {
+        memcpy(out[i], staging + direct_len * i, sizeof(T));
+      }
+      std::free(staging);
+    }
+    delete[] reads;
+  }
+
+  // return the slot to the free list, write() hands it out again
+  void Delete(int index) {
+    loadFreeHead();
+    writeAt(reinterpret_cast<char*>(&free_head), sizeof(int), index, true);
+    free_head = index;
+    storeFreeHead();
+  }
+
+  bool exist() const { return access(file_name.c_str(), F_OK) == 0; }
+
+  // nothing is buffered in user space
+  void flush() {}
+
+  void close() {
+    if (fd != -1) {
+      ::close(fd);
+      fd = -1;
+    }
+    direct = false;
+    free_head = -1;
+    file_end = -1;
+  }
+};
+
+#endif  // BPT_FILE_MEMORYRIVER_HPP
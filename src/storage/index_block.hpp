@@ -1,24 +1,39 @@
 #pragma once
 #include <string>
 
+#include "separator_traits.hpp"
+
+// Three-way comparison of keys: negative, zero or positive. Types with a
+// compare member (FixedString, Route, Key_Value) answer in one call, the
+// rest are ordered by operator<.
+template <class T>
+auto compareKeys(const T& a, const T& b, int) -> decltype(a.compare(b)) {
+  return a.compare(b);
+}
+
+template <class T>
+int compareKeys(const T& a, const T& b, long) {
+  return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+template <class T>
+int compareKeys(const T& a, const T& b) {
+  return compareKeys(a, b, 0);
+}
+
 template <class Key, class Value>
 struct Key_Value {
   Key key;
   Value value;
 
-  bool operator<(const Key_Value& other) const {
-    if (key == other.key) {
-      return value < other.value;
-    }
-    return key < other.key;
+  int compare(const Key_Value& other) const {
+    int cmp = compareKeys(key, other.key);
+    return cmp != 0 ? cmp : compareKeys(value, other.value);
   }
 
-  bool operator>(const Key_Value& other) const {
-    if (key == other.key) {
-      return value > other.value;
-    }
-    return key > other.key;
-  }
+  bool operator<(const Key_Value& other) const { return compare(other) < 0; }
+
+  bool operator>(const Key_Value& other) const { return compare(other) > 0; }
 
   bool operator==(const Key_Value& other) const {
     return key == other.key && value == other.value;
@@ -27,22 +42,63 @@ struct Key_Value {
   bool operator!=(const Key_Value& other) const { return !(*this == other); }
 
   bool operator<=(const Key_Value& other) const {
-    return *this < other || *this == other;
+    return compare(other) <= 0;
   }
 
   bool operator>=(const Key_Value& other) const {
-    return *this > other || *this == other;
+    return compare(other) >= 0;
   }
 };
 
-constexpr size_t DEFAULT_ORDER = 15;
-constexpr size_t DEFAULT_LEAF_SIZE = 30;
+// Nodes are sized to fill whole pages of this many bytes, override with
+// -DBPT_PAGE_SIZE=...
+#ifndef BPT_PAGE_SIZE
+#define BPT_PAGE_SIZE 4096
+#endif
+constexpr size_t NODE_PAGE_SIZE = BPT_PAGE_SIZE;
+// a node spans more pages rather than holding fewer entries than this
+constexpr size_t MIN_NODE_CAPACITY = 8;
+// room for size, next and alignment padding
+constexpr size_t NODE_OVERHEAD = 4 * sizeof(size_t);
 
-// Increment the size of keys to facilitate split
+// the key plus the value's tiebreaker, see SeparatorTraits
+template <class Key, class Value>
+using Separator = Key_Value<Key, typename SeparatorTraits<Value>::Tie>;
+
+template <class Key, class Value>
+Separator<Key, Value> separatorOf(const Key_Value<Key, Value>& kv) {
+  return {kv.key, SeparatorTraits<Value>::tie(kv.value)};
+}
+
+// how many entries of entry_size bytes fill the fewest whole pages that
+// still hold MIN_NODE_CAPACITY of them
+constexpr size_t pageCapacity(size_t entry_size) {
+  size_t pages = 1;
+  while ((pages * NODE_PAGE_SIZE - NODE_OVERHEAD) / entry_size <
+         MIN_NODE_CAPACITY) {
+    pages++;
+  }
+  return (pages * NODE_PAGE_SIZE - NODE_OVERHEAD) / entry_size;
+}
+
+// fanout of an internal node: each key comes with one child pointer
 template <class Key, class Value>
+constexpr size_t defaultOrder() {
+  return pageCapacity(sizeof(Separator<Key, Value>) + sizeof(int)) - 1;
+}
+
+// entries of a leaf, which keeps one spare slot for the entry that
+// triggers a split
+template <class Key, class Value>
+constexpr size_t defaultLeafSize() {
+  return pageCapacity(sizeof(Key_Value<Key, Value>)) - 1;
+}
+
+// Increment the size of keys to facilitate split
+template <class Key, class Value, size_t ORDER = defaultOrder<Key, Value>()>
 struct Index {
-  int children[DEFAULT_ORDER + 1];
-  Key_Value<Key, Value> keys[DEFAULT_ORDER];
+  int children[ORDER + 1];
+  Separator<Key, Value> keys[ORDER];
   size_t size;
 
   Index() : size(0) {}
@@ -87,10 +143,11 @@ struct Index {
   }
 };
 
-template <class Key, class Value>
+template <class Key, class Value,
+          size_t LEAF_SIZE = defaultLeafSize<Key, Value>()>
 struct Block {
   int next;
-  Key_Value<Key, Value> data[DEFAULT_LEAF_SIZE + 1];
+  Key_Value<Key, Value> data[LEAF_SIZE + 1];
   size_t size;
 
   Block() : next(-1), size(0) {}
@@ -129,4 +186,31 @@ struct Block {
     }
     return *this;
   }
-};
\ No newline at end of file
+};
+// Nodes of a UniqueBPT pair every key with one int: a child pointer in an
+// internal node, the address of the value record in a leaf.
+template <class Key>
+constexpr size_t defaultUniqueOrder() {
+  return pageCapacity(sizeof(Key) + sizeof(int)) - 1;
+}
+
+// keys[i] is the smallest key below children[i + 1]
+template <class Key, size_t ORDER = defaultUniqueOrder<Key>()>
+struct UniqueIndex {
+  int children[ORDER + 1];
+  Key keys[ORDER];
+  size_t size;
+
+  UniqueIndex() : size(0) {}
+};
+
+// values[i] is the address of the value stored under keys[i]
+template <class Key, size_t LEAF_SIZE = defaultUniqueOrder<Key>()>
+struct UniqueBlock {
+  int next;
+  Key keys[LEAF_SIZE + 1];
+  int values[LEAF_SIZE + 1];
+  size_t size;
+
+  UniqueBlock() : next(-1), size(0) {}
+};
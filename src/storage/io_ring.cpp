@@ -0,0 +1,193 @@
+#include "io_ring.hpp"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+void preadFully(int fd, char* buf, size_t len, int64_t offset) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t got = ::pread(fd, buf + done, len - done, offset + done);
+    if (got <= 0) {
+      break;
+    }
+    done += got;
+  }
+  memset(buf + done, 0, len - done);
+}
+
+void pwriteFully(int fd, const char* buf, size_t len, int64_t offset) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t put = ::pwrite(fd, buf + done, len - done, offset + done);
+    if (put <= 0) {
+      break;
+    }
+    done += put;
+  }
+}
+
+IoRing& IoRing::instance() {
+  static IoRing ring;
+  return ring;
+}
+
+IoRing::IoRing() { setup(); }
+
+IoRing::~IoRing() {
+#ifdef USE_IO_URING
+  if (ring_fd_ == -1) {
+    return;
+  }
+  munmap(sqes_, sqes_size_);
+  if (cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  munmap(sq_ring_, sq_ring_size_);
+  ::close(ring_fd_);
+#endif
+}
+
+void IoRing::setup() {
+#ifdef USE_IO_URING
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = syscall(__NR_io_uring_setup, IO_RING_ENTRIES, &params);
+  if (fd < 0) {
+    return;
+  }
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single && cq_ring_size_ > sq_ring_size_) {
+    sq_ring_size_ = cq_ring_size_;
+  }
+  void* sq = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED) {
+    ::close(fd);
+    return;
+  }
+  void* cq = sq;
+  if (!single) {
+    cq = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  }
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (cq == MAP_FAILED || sqes == MAP_FAILED) {
+    if (sqes != MAP_FAILED) {
+      munmap(sqes, sqes_size_);
+    }
+    if (cq != MAP_FAILED && cq != sq) {
+      munmap(cq, cq_ring_size_);
+    }
+    munmap(sq, sq_ring_size_);
+    ::close(fd);
+    return;
+  }
+  ring_fd_ = fd;
+  entries_ = params.sq_entries;
+  sq_ring_ = static_cast<char*>(sq);
+  cq_ring_ = static_cast<char*>(cq);
+  sqes_ = sqes;
+  sq_tail_ = params.sq_off.tail;
+  sq_mask_ = params.sq_off.ring_mask;
+  sq_array_ = params.sq_off.array;
+  cq_head_ = params.cq_off.head;
+  cq_tail_ = params.cq_off.tail;
+  cq_mask_ = params.cq_off.ring_mask;
+  cq_cqes_ = params.cq_off.cqes;
+#endif
+}
+
+void IoRing::read(IoRead* reads, int n) {
+  if (n <= 0) {
+    return;
+  }
+  batches_++;
+  reads_ += n;
+  if (ring_fd_ == -1 || n == 1) {
+    for (int i = 0; i < n; ++i) {
+      preadFully(reads[i].fd, reads[i].buf, reads[i].len, reads[i].offset);
+    }
+    return;
+  }
+  for (int from = 0; from < n; from += entries_) {
+    int count = n - from < static_cast<int>(entries_) ? n - from : entries_;
+    submit(reads + from, count);
+  }
+}
+
+void IoRing::submit(IoRead* reads, int n) {
+#ifdef USE_IO_URING
+  unsigned* sq_tail = reinterpret_cast<unsigned*>(sq_ring_ + sq_tail_);
+  unsigned mask = *reinterpret_cast<unsigned*>(sq_ring_ + sq_mask_);
+  unsigned* array = reinterpret_cast<unsigned*>(sq_ring_ + sq_array_);
+  io_uring_sqe* sqes = static_cast<io_uring_sqe*>(sqes_);
+  unsigned tail = *sq_tail;
+  for (int i = 0; i < n; ++i) {
+    unsigned slot = (tail + i) & mask;
+    io_uring_sqe& sqe = sqes[slot];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = reads[i].fd;
+    sqe.addr = reinterpret_cast<uint64_t>(reads[i].buf);
+    sqe.len = reads[i].len;
+    sqe.off = reads[i].offset;
+    sqe.user_data = i;
+    array[slot] = slot;
+  }
+  // the kernel must see the entries before the new tail
+  __atomic_store_n(sq_tail, tail + n, __ATOMIC_RELEASE);
+
+  unsigned* cq_head = reinterpret_cast<unsigned*>(cq_ring_ + cq_head_);
+  unsigned* cq_tail = reinterpret_cast<unsigned*>(cq_ring_ + cq_tail_);
+  unsigned cq_mask = *reinterpret_cast<unsigned*>(cq_ring_ + cq_mask_);
+  io_uring_cqe* cqes = reinterpret_cast<io_uring_cqe*>(cq_ring_ + cq_cqes_);
+  int to_submit = n;
+  int done = 0;
+  while (done < n) {
+    int ret = syscall(__NR_io_uring_enter, ring_fd_, to_submit, n - done,
+                      IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (ret < 0) {
+      if (errno == EINTR || to_submit < n) {
+        continue;
+      }
+      // the kernel took nothing, so take the entries back and read them
+      // one by one
+      __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+      for (int i = 0; i < n; ++i) {
+        preadFully(reads[i].fd, reads[i].buf, reads[i].len, reads[i].offset);
+      }
+      return;
+    }
+    to_submit -= ret < to_submit ? ret : to_submit;
+    unsigned head = *cq_head;
+    unsigned ready = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != ready; ++head, ++done) {
+      const io_uring_cqe& cqe = cqes[head & cq_mask];
+      IoRead& read = reads[cqe.user_data];
+      // a failed or short read is finished synchronously
+      size_t got = cqe.res < 0 ? 0 : cqe.res;
+      if (got < read.len) {
+        preadFully(read.fd, read.buf + got, read.len - got,
+                   read.offset + got);
+      }
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+  }
+#else
+  (void)reads;
+  (void)n;
+#endif
+}
@@ -0,0 +1,65 @@
+#ifndef BPT_IO_RING_HPP
+#define BPT_IO_RING_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Submission queue size of the ring; longer batches go in several rounds.
+#ifndef IO_RING_ENTRIES
+#define IO_RING_ENTRIES 64
+#endif
+
+// One positional read of a batch.
+struct IoRead {
+  int fd;
+  char* buf;
+  size_t len;
+  int64_t offset;
+};
+
+// Issues batches of positional reads. Built with USE_IO_URING, a batch is
+// queued on an io_uring and handed to the kernel with one system call, so
+// the reads overlap; otherwise, or when the kernel refuses the ring, they
+// are issued one pread at a time. Bytes past the end of a file read as 0.
+class IoRing {
+ public:
+  static IoRing& instance();
+
+  void read(IoRead* reads, int n);
+
+  // whether batches really go through io_uring
+  bool active() const { return ring_fd_ != -1; }
+  size_t batches() const { return batches_; }
+  size_t reads() const { return reads_; }
+
+ private:
+  int ring_fd_{-1};
+  unsigned entries_{0};
+  char* sq_ring_{nullptr};
+  char* cq_ring_{nullptr};
+  size_t sq_ring_size_{0};
+  size_t cq_ring_size_{0};
+  void* sqes_{nullptr};
+  size_t sqes_size_{0};
+  // offsets of the ring fields, as reported by io_uring_setup
+  unsigned sq_tail_, sq_mask_, sq_array_;
+  unsigned cq_head_, cq_tail_, cq_mask_, cq_cqes_;
+
+  size_t batches_{0};
+  size_t reads_{0};
+
+  IoRing();
+  ~IoRing();
+  IoRing(const IoRing&) = delete;
+  IoRing& operator=(const IoRing&) = delete;
+
+  void setup();
+  // submit up to entries_ reads and wait for all of them
+  void submit(IoRead* reads, int n);
+};
+
+// read len bytes at offset, zero filling past the end of the file
+void preadFully(int fd, char* buf, size_t len, int64_t offset);
+void pwriteFully(int fd, const char* buf, size_t len, int64_t offset);
+
+#endif  // BPT_IO_RING_HPP
@@ -0,0 +1,220 @@
+#ifndef BPT_MAPPED_MEMORYRIVER_HPP
+#define BPT_MAPPED_MEMORYRIVER_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+
+// The mapping grows in extents of at least this many bytes.
+constexpr size_t MAPPED_RIVER_EXTENT = 1 << 20;
+
+// MemoryRiver with the same interface, backed by mmap. Records are handed
+// out as references into the mapping, so a read is a pointer dereference.
+// References are invalidated by write(), which may move the mapping when it
+// has to grow.
+// The file is reserved in whole extents and only cut back to the bytes in
+// use on close, so the header also records that count: after a crash the
+// file length still includes the padding.
+template <class T, int info_len = 2, int align = 1>
+class MappedMemoryRiver {
+ private:
+  std::string file_name;
+  int fd = -1;
+  char* base = nullptr;
+  size_t mapped_size = 0;   // bytes reserved in the file and mapping
+  size_t logical_size = 0;  // bytes actually in use
+
+  // header slot after the user info, 0 marks an empty free list
+  int& freeHead() {
+    return *reinterpret_cast<int*>(base + info_len * sizeof(int));
+  }
+
+  // the slot after the header holds logical_size
+  void storeSize() {
+    int used = logical_size;
+    memcpy(base + header_size, &used, sizeof(int));
+  }
+
+  void ensureFileOpen() {
+    if (fd != -1) return;
+    fd = ::open(file_name.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    fstat(fd, &st);
+    size_t file_size = st.st_size;
+    mapped_size = 0;
+    reserve(file_size == 0 ? MAPPED_RIVER_EXTENT : file_size);
+    logical_size = file_size;
+    if (file_size >= static_cast<size_t>(data_offset)) {
+      int used;
+      memcpy(&used, base + header_size, sizeof(int));
+      if (used >= data_offset && static_cast<size_t>(used) <= file_size) {
+        logical_size = used;
+      }
+    }
+  }
+
+  void reserve(size_t bytes) {
+    if (bytes <= mapped_size) return;
+    size_t new_size = mapped_size == 0 ? MAPPED_RIVER_EXTENT : mapped_size;
+    while (new_size < bytes) {
+      new_size += new_size < (64u << 20) ? new_size : (64u << 20);
+    }
+    new_size = (new_size + MAPPED_RIVER_EXTENT - 1) / MAPPED_RIVER_EXTENT *
+               MAPPED_RIVER_EXTENT;
+    ftruncate(fd, new_size);
+    void* addr;
+    if (base == nullptr) {
+      addr = mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    } else {
+      addr = mremap(base, mapped_size, new_size, MREMAP_MAYMOVE);
+    }
+    base = static_cast<char*>(addr);
+    mapped_size = new_size;
+  }
+
+ public:
+  static constexpr bool is_mapped = true;
+  // info ints followed by the free list head, see read_header
+  static constexpr int header_size = (info_len + 1) * sizeof(int);
+  // records start after the header and the bytes in use
+  static constexpr int data_offset =
+      (header_size + static_cast<int>(sizeof(int)) + align - 1) / align *
+      align;
+  static constexpr int stride = (sizeof(T) + align - 1) / align * align;
+
+  MappedMemoryRiver() = default;
+
+  MappedMemoryRiver(const std::string& file_name) : file_name(file_name) {}
+
+  ~MappedMemoryRiver() { close(); }
+
+  MappedMemoryRiver(const MappedMemoryRiver&) = delete;
+  MappedMemoryRiver& operator=(const MappedMemoryRiver&) = delete;
+
+  MappedMemoryRiver(MappedMemoryRiver&& other) noexcept
+      : file_name(std::move(other.file_name)),
+        fd(other.fd),
+        base(other.base),
+        mapped_size(other.mapped_size),
+        logical_size(other.logical_size) {
+    other.fd = -1;
+    other.base = nullptr;
+  }
+
+  void initialise(std::string FN = "") {
+    if (FN != "") file_name = FN;
+    close();
+    fd = ::open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    logical_size = data_offset;
+    reserve(logical_size);
+    memset(base, 0, logical_size);
+    storeSize();
+  }
+
+  const std::string& name() const { return file_name; }
+
+  void get_info(int& tmp, int n) {
+    if (n > info_len) return;
+    ensureFileOpen();
+    memcpy(&tmp, base + (n - 1) * sizeof(int), sizeof(int));
+  }
+
+  void write_info(int tmp, int n) {
+    if (n > info_len) return;
+    ensureFileOpen();
+    memcpy(base + (n - 1) * sizeof(int), &tmp, sizeof(int));
+  }
+
+  void read_header(char* header) {
+    ensureFileOpen();
+    memcpy(header, base, header_size);
+  }
+
+  void write_header(const char* header) {
+    ensureFileOpen();
+    memcpy(base, header, header_size);
+  }
+
+  int allocate() {
+    ensureFileOpen();
+    int index = logical_size;
+    reserve(logical_size + stride);
+    logical_size += stride;
+    storeSize();
+    return index;
+  }
+
+  // slots handed out so far, live or free; every record address lies
+  // below data_offset + slots() * stride
+  int slots() {
+    ensureFileOpen();
+    if (logical_size <= static_cast<size_t>(data_offset)) return 0;
+    return (logical_size - data_offset + stride - 1) / stride;
+  }
+
+  int write(T& t) {
+    ensureFileOpen();
+    int index = freeHead();
+    if (index != 0) {
+      memcpy(&freeHead(), base + index, sizeof(int));
+      memcpy(base + index, &t, sizeof(T));
+      return index;
+    }
+    index = allocate();
+    memcpy(base + index, &t, sizeof(T));
+    return index;
+  }
+
+  void update(T& t, const int index) {
+    ensureFileOpen();
+    memcpy(base + index, &t, sizeof(T));
+  }
+
+  void read(T& t, const int index) {
+    ensureFileOpen();
+    memcpy(&t, base + index, sizeof(T));
+  }
+
+  void read_batch(T* const* out, const int* indexes, int n) {
+    for (int i = 0; i < n; ++i) {
+      read(*out[i], indexes[i]);
+    }
+  }
+
+  // typed reference into the mapping, valid until the next write()
+  T& at(const int index) {
+    ensureFileOpen();
+    return *reinterpret_cast<T*>(base + index);
+  }
+
+  // return the slot to the free list, write() hands it out again
+  void Delete(int index) {
+    ensureFileOpen();
+    memcpy(base + index, &freeHead(), sizeof(int));
+    freeHead() = index;
+  }
+
+  bool exist() const { return access(file_name.c_str(), F_OK) == 0; }
+
+  void flush() {
+    if (base != nullptr) {
+      msync(base, logical_size, MS_ASYNC);
+    }
+  }
+
+  void close() {
+    if (fd == -1) return;
+    munmap(base, mapped_size);
+    ftruncate(fd, logical_size);
+    ::close(fd);
+    fd = -1;
+    base = nullptr;
+    mapped_size = 0;
+  }
+};
+
+#endif  // BPT_MAPPED_MEMORYRIVER_HPP
@@ -1,6 +1,7 @@
 #ifndef BPT_MEMORYRIVER_HPP
 #define BPT_MEMORYRIVER_HPP
 
+#include <cstring>
 #include <fstream>
 
 using std::fstream;
@@ -8,7 +9,9 @@ using std::ifstream;
 using std::ofstream;
 using std::string;
 
-template <class T, int info_len = 2>
+// With align > 1 the first record starts on an align boundary and every
+// record occupies a whole number of align-sized units.
+template <class T, int info_len = 2, int align = 1>
 class MemoryRiver {
  private:
   mutable fstream file;
@@ -16,6 +19,45 @@ class MemoryRiver {
   mutable bool file_opened = false;
   int sizeofT = sizeof(T);
 
+  // 0 is never a record offset, so it marks an empty free list on disk
+  int free_head = -1;
+  // end of the last handed out slot, which may lie beyond the end of the
+  // file while allocated records are still waiting in the buffer pool
+  int file_end = -1;
+
+  void loadFileEnd() {
+    if (file_end != -1) return;
+    file.seekp(0, std::ios::end);
+    int end = file.tellp();
+    // the last record may end short of its stride
+    int records = end <= data_offset ? 0 : (end - data_offset - 1) / stride + 1;
+    file_end = data_offset + records * stride;
+  }
+
+  void loadFreeHead() {
+    if (free_head != -1) return;
+    file.seekg(info_len * sizeof(int), std::ios::beg);
+    if (!file.read(reinterpret_cast<char*>(&free_head), sizeof(int))) {
+      file.clear();
+      free_head = 0;
+    }
+  }
+
+  void storeFreeHead() {
+    file.seekp(info_len * sizeof(int), std::ios::beg);
+    file.write(reinterpret_cast<char*>(&free_head), sizeof(int));
+  }
+
+  int popFreeSlot() {
+    loadFreeHead();
+    int index = free_head;
+    if (index == 0) return 0;
+    file.seekg(index, std::ios::beg);
+    file.read(reinterpret_cast<char*>(&free_head), sizeof(int));
+    storeFreeHead();
+    return index;
+  }
+
   void ensureFileOpen() const {
     if (!file_opened) {
       file.open(file_name, std::ios::in | std::ios::out | std::ios::binary);
@@ -30,6 +72,13 @@ class MemoryRiver {
   }
 
  public:
+  static constexpr bool is_mapped = false;
+  // info ints followed by the free list head
+  static constexpr int header_size = (info_len + 1) * sizeof(int);
+  // offset of the first record and distance between records
+  static constexpr int data_offset = (header_size + align - 1) / align * align;
+  static constexpr int stride = (sizeof(T) + align - 1) / align * align;
+
   MemoryRiver() = default;
 
   MemoryRiver(const string& file_name) : file_name(file_name) {}
@@ -46,7 +95,10 @@ class MemoryRiver {
 
   // 支持移动语义
   MemoryRiver(MemoryRiver&& other) noexcept
-      : file_name(std::move(other.file_name)), file_opened(other.file_opened) {
+      : file_name(std::move(other.file_name)),
+        file_opened(other.file_opened),
+        free_head(other.free_head),
+        file_end(other.file_end) {
     if (file_opened) {
       file = std::move(other.file);
       other.file_opened = false;
@@ -64,13 +116,18 @@ class MemoryRiver {
 
     file.open(file_name, std::ios::out | std::ios::binary);
     int tmp = 0;
-    for (int i = 0; i < info_len; ++i) {
+    // info_len user ints followed by the head of the free slot list
+    for (int i = 0; i <= info_len; ++i) {
       file.write(reinterpret_cast<char*>(&tmp), sizeof(int));
     }
     file.close();
     file_opened = false;
+    free_head = 0;
+    file_end = data_offset;
   }
 
+  const string& name() const { return file_name; }
+
   void get_info(int& tmp, int n) {
     if (n > info_len) return;
     ensureFileOpen();
@@ -83,18 +140,54 @@ class MemoryRiver {
     ensureFileOpen();
     file.seekp((n - 1) * sizeof(int), std::ios::beg);
     file.write(reinterpret_cast<char*>(&tmp), sizeof(int));
-    file.flush();  // 确保写入磁盘
+  }
+
+  // the whole header, for callers that keep the free list themselves
+  void read_header(char* header) {
+    ensureFileOpen();
+    file.seekg(0, std::ios::beg);
+    if (!file.read(header, header_size)) {
+      // files written before the free list existed end after the info
+      file.clear();
+      memset(header + file.gcount(), 0, header_size - file.gcount());
+    }
+  }
+
+  void write_header(const char* header) {
+    ensureFileOpen();
+    file.seekp(0, std::ios::beg);
+    file.write(header, header_size);
+    free_head = -1;
+  }
+
+  // hand out a fresh slot at the end without writing it
+  int allocate() {
+    ensureFileOpen();
+    loadFileEnd();
+    int index = file_end;
+    file_end += stride;
+    return index;
+  }
+
+  // slots handed out so far, live or free; every record address lies
+  // below data_offset + slots() * stride
+  int slots() {
+    ensureFileOpen();
+    loadFileEnd();
+    return (file_end - data_offset) / stride;
   }
 
   int write(T& t) {
     ensureFileOpen();
-    file.seekp(0, std::ios::end);
-    int index = file.tellp();
-    if (index == -1) {
-      return -1;
+    int index = popFreeSlot();
+    if (index == 0) {
+      index = allocate();
+      if (index == -1) {
+        return -1;
+      }
     }
+    file.seekp(index, std::ios::beg);
     file.write(reinterpret_cast<char*>(&t), sizeof(T));
-    file.flush();
     return index;
   }
 
@@ -102,7 +195,6 @@ class MemoryRiver {
     ensureFileOpen();
     file.seekp(index, std::ios::beg);
     file.write(reinterpret_cast<char*>(&t), sizeof(T));
-    file.flush();
   }
 
   void read(T& t, const int index) {
@@ -111,19 +203,21 @@ class MemoryRiver {
     file.read(reinterpret_cast<char*>(&t), sizeof(T));
   }
 
+  // read n records; out[i] receives the record at indexes[i]
+  void read_batch(T* const* out, const int* indexes, int n) {
+    for (int i = 0; i < n; ++i) {
+      read(*out[i], indexes[i]);
+    }
+  }
+
+  // return the slot to the free list, write() hands it out again
   void Delete(int index) {
     ensureFileOpen();
-    file.seekg(0, std::ios::end);
-    std::streamsize size = file.tellg();
-    if (index + sizeof(T) >= size) return;
-
-    file.seekg(index + sizeof(T), std::ios::beg);
-    char* buffer = new char[size - index - sizeof(T)];
-    file.read(buffer, size - index - sizeof(T));
+    loadFreeHead();
     file.seekp(index, std::ios::beg);
-    file.write(buffer, size - index - sizeof(T));
-    file.flush();
-    delete[] buffer;
+    file.write(reinterpret_cast<char*>(&free_head), sizeof(int));
+    free_head = index;
+    storeFreeHead();
   }
 
   bool exist() const {
@@ -142,6 +236,8 @@ class MemoryRiver {
       file.close();
       file_opened = false;
     }
+    free_head = -1;
+    file_end = -1;
   }
 };
 
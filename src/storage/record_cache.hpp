@@ -0,0 +1,217 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "../stl/vector.hpp"
+#include "cache.hpp"
+
+// Memory budget of a RecordCache in bytes, override with
+// -DRECORD_CACHE_CAPACITY=...
+#ifndef RECORD_CACHE_CAPACITY
+#define RECORD_CACHE_CAPACITY (2u << 20)
+#endif
+
+// Write-back copies of the most recently used records of a PagedFile, for
+// small records that are read and changed far more often than they are
+// added. A hit is one hash probe, without pinning a pool page. Changes stay
+// in the copies until writeBack hands them to the file, or until their
+// copy is evicted in LRU order; through the file they reach the buffer
+// pool and so the log, which is why writeBack has to run before a command
+// commits. Records have to be added through the file itself.
+template <class T, int info_len = 2, int align = 1>
+class RecordCache {
+ public:
+  using File = sjtu::PagedFile<T, info_len, align>;
+
+  explicit RecordCache(File& file, size_t capacity = RECORD_CACHE_CAPACITY)
+      : file_(file) {
+    size_t count = capacity / sizeof(Entry);
+    capacity_ = count < 16 ? 16 : count;
+    size_t buckets = 16;
+    shift_ = 28;
+    while (buckets < 2 * capacity_) {
+      buckets *= 2;
+      shift_--;
+    }
+    for (size_t i = 0; i < buckets; ++i) {
+      buckets_.push_back(-1);
+    }
+  }
+  ~RecordCache() { writeBack(); }
+
+  RecordCache(const RecordCache&) = delete;
+  RecordCache& operator=(const RecordCache&) = delete;
+
+  // the record at addr, read through the file only on a miss; the
+  // reference stays valid until the next call
+  const T& get(int addr) { return entries_[acquire(addr)].record; }
+
+  // replace the record at addr; the file sees it at the next writeBack
+  void put(const T& record, int addr) {
+    int idx = acquire(addr, false);
+    entries_[idx].record = record;
+    if (!entries_[idx].dirty) {
+      entries_[idx].dirty = true;
+      dirty_.push_back(idx);
+    }
+  }
+
+  // the record at addr, to be changed in place; the file sees it at the
+  // next writeBack. The reference stays valid until the next call
+  T& modify(int addr) {
+    int idx = acquire(addr);
+    if (!entries_[idx].dirty) {
+      entries_[idx].dirty = true;
+      dirty_.push_back(idx);
+    }
+    return entries_[idx].record;
+  }
+
+  // let the file load the records of addrs that have no copy, in one batch
+  void prefetch(const int* addrs, int n) {
+    sjtu::vector<int> missing;
+    for (int i = 0; i < n; ++i) {
+      if (lookup(addrs[i]) == -1) {
+        missing.push_back(addrs[i]);
+      }
+    }
+    if (!missing.empty()) {
+      file_.prefetch(&missing[0], missing.size());
+    }
+  }
+
+  // hand every changed record to the file
+  void writeBack() {
+    for (size_t i = 0; i < dirty_.size(); ++i) {
+      Entry& entry = entries_[dirty_[i]];
+      // an evicted copy was written then, and its entry may be reused
+      if (entry.dirty) {
+        file_.update(entry.record, entry.addr);
+        entry.dirty = false;
+      }
+    }
+    dirty_.clear();
+  }
+
+  // drop every copy without writing it, e.g. when the file is replaced
+  void clear() {
+    entries_.clear();
+    dirty_.clear();
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+      buckets_[i] = -1;
+    }
+    lru_head_ = lru_tail_ = -1;
+  }
+
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+ private:
+  struct Entry {
+    T record;
+    int addr;
+    bool dirty;
+    int prev;  // LRU list, head is the most recently used
+    int next;
+    int hash_next;
+  };
+
+  File& file_;
+  size_t capacity_;
+  int shift_;
+  sjtu::vector<Entry> entries_;
+  sjtu::vector<int> buckets_;
+  sjtu::vector<int> dirty_;
+  int lru_head_{-1};
+  int lru_tail_{-1};
+
+  size_t hits_{0};
+  size_t misses_{0};
+
+  // the high bits of a multiplicative hash, as addresses share low bits
+  size_t bucketOf(int addr) const {
+    return (static_cast<uint32_t>(addr) * 2654435761u) >> shift_;
+  }
+
+  int lookup(int addr) const {
+    int idx = buckets_[bucketOf(addr)];
+    while (idx != -1 && entries_[idx].addr != addr) {
+      idx = entries_[idx].hash_next;
+    }
+    return idx;
+  }
+
+  // the entry holding addr, most recently used now; a new entry is read
+  // from the file only if load is set
+  int acquire(int addr, bool load = true) {
+    int idx = lookup(addr);
+    if (idx != -1) {
+      hits_++;
+      if (idx != lru_head_) {
+        unlink(idx);
+        pushFront(idx);
+      }
+      return idx;
+    }
+    misses_++;
+    if (entries_.size() < capacity_) {
+      entries_.push_back(Entry{});
+      idx = entries_.size() - 1;
+    } else {
+      idx = lru_tail_;
+      evict(idx);
+    }
+    Entry& entry = entries_[idx];
+    entry.addr = addr;
+    entry.dirty = false;
+    if (load) {
+      file_.read(entry.record, addr);
+    }
+    size_t bucket = bucketOf(addr);
+    entry.hash_next = buckets_[bucket];
+    buckets_[bucket] = idx;
+    pushFront(idx);
+    return idx;
+  }
+
+  void evict(int idx) {
+    Entry& entry = entries_[idx];
+    if (entry.dirty) {
+      file_.update(entry.record, entry.addr);
+      entry.dirty = false;
+    }
+    unlink(idx);
+    int* link = &buckets_[bucketOf(entry.addr)];
+    while (*link != idx) {
+      link = &entries_[*link].hash_next;
+    }
+    *link = entry.hash_next;
+  }
+
+  void unlink(int idx) {
+    Entry& entry = entries_[idx];
+    if (entry.prev != -1) {
+      entries_[entry.prev].next = entry.next;
+    } else {
+      lru_head_ = entry.next;
+    }
+    if (entry.next != -1) {
+      entries_[entry.next].prev = entry.prev;
+    } else {
+      lru_tail_ = entry.prev;
+    }
+  }
+
+  void pushFront(int idx) {
+    Entry& entry = entries_[idx];
+    entry.prev = -1;
+    entry.next = lru_head_;
+    if (lru_head_ != -1) {
+      entries_[lru_head_].prev = idx;
+    }
+    lru_head_ = idx;
+    if (lru_tail_ == -1) {
+      lru_tail_ = idx;
+    }
+  }
+};
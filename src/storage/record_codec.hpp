@@ -0,0 +1,270 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+#include "../model/order.hpp"
+#include "../model/train.hpp"
+#include "../model/user.hpp"
+
+// bytes of a varint carrying 32 and 64 bits
+constexpr int VARINT32_MAX = 5;
+constexpr int VARINT64_MAX = 10;
+
+// bytes a FixedString<N> takes at most: its length, then its characters
+template <size_t N>
+constexpr int encodedStringMax() {
+  return (N < 128 ? 1 : 2) + N;
+}
+
+// Appends the compact encoding of a record to a buffer large enough for
+// the record's RecordCodec::max_size.
+class RecordWriter {
+ public:
+  explicit RecordWriter(char* buf) : buf_(buf) {}
+
+  int size() const { return pos_; }
+
+  void putByte(uint8_t byte) { buf_[pos_++] = byte; }
+
+  void putBytes(const void* data, int len) {
+    memcpy(buf_ + pos_, data, len);
+    pos_ += len;
+  }
+
+  // 7 bits a byte, low bits first
+  void putUint(uint64_t value) {
+    while (value >= 0x80) {
+      buf_[pos_++] = static_cast<char>(value | 0x80);
+      value >>= 7;
+    }
+    buf_[pos_++] = static_cast<char>(value);
+  }
+
+  // zigzag, so that small negative numbers stay short
+  void putInt(int value) {
+    putUint((static_cast<uint32_t>(value) << 1) ^
+            static_cast<uint32_t>(value >> 31));
+  }
+
+  template <size_t N>
+  void putString(const FixedString<N>& s) {
+    putUint(s.length);
+    memcpy(buf_ + pos_, s.string, s.length);
+    pos_ += s.length;
+  }
+
+  void putDate(const Date& date) {
+    putInt(date.month);
+    putInt(date.day);
+  }
+
+ private:
+  char* buf_;
+  int pos_{0};
+};
+
+// Reads back what a RecordWriter wrote, in the same order.
+class RecordReader {
+ public:
+  explicit RecordReader(const char* buf) : buf_(buf) {}
+
+  uint8_t getByte() { return buf_[pos_++]; }
+
+  void getBytes(void* data, int len) {
+    memcpy(data, buf_ + pos_, len);
+    pos_ += len;
+  }
+
+  uint64_t getUint() {
+    uint64_t value = 0;
+    int shift = 0;
+    uint8_t byte;
+    do {
+      byte = buf_[pos_++];
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    return value;
+  }
+
+  int getInt() {
+    uint32_t value = getUint();
+    return static_cast<int>((value >> 1) ^ -(value & 1));
+  }
+
+  template <size_t N>
+  void getString(FixedString<N>& s) {
+    s.length = getUint();
+    memcpy(s.string, buf_ + pos_, s.length);
+    s.string[s.length] = '\0';
+    pos_ += s.length;
+  }
+
+  void getDate(Date& date) {
+    date.month = getInt();
+    date.day = getInt();
+  }
+
+ private:
+  const char* buf_;
+  int pos_{0};
+};
+
+// On-disk encoding of a record type: strings carry their length instead of
+// padding, and integers are varints. encode writes at most max_size bytes.
+// Types without an encoding of their own are stored as their raw bytes.
+template <class T>
+struct RecordCodec {
+  static constexpr int max_size = sizeof(T);
+
+  static void encode(const T& record, RecordWriter& out) {
+    out.putBytes(&record, sizeof(T));
+  }
+
+  static void decode(RecordReader& in, T& record) {
+    in.getBytes(&record, sizeof(T));
+  }
+};
+
+// Only the stations the train stops at are kept. Prices are stored as the
+// fare of each leg and times as the hours since the previous time, as both
+// only ever grow along the route.
+template <>
+struct RecordCodec<Train> {
+  static constexpr int max_size =
+      encodedStringMax<20>() + 2 * VARINT32_MAX +
+      MAX_STATION_NUM * (encodedStringMax<30>() + 5 * VARINT32_MAX) +
+      4 * VARINT32_MAX + 2 + VARINT32_MAX;
+
+  static void encode(const Train& train, RecordWriter& out) {
+    out.putString(train.train_id);
+    out.putInt(train.station_num);
+    out.putInt(train.seat_num);
+    int hour = 0;
+    for (int i = 0; i < train.station_num; ++i) {
+      out.putString(train.stations[i]);
+      out.putInt(train.prices[i] - (i > 0 ? train.prices[i - 1] : 0));
+      out.putInt(train.arrival_times[i].hour - hour);
+      out.putInt(train.arrival_times[i].minute);
+      hour = train.arrival_times[i].hour;
+      out.putInt(train.departure_times[i].hour - hour);
+      out.putInt(train.departure_times[i].minute);
+      hour = train.departure_times[i].hour;
+    }
+    out.putDate(train.sale_date_start);
+    out.putDate(train.sale_date_end);
+    out.putByte(train.type);
+    out.putByte(train.is_released);
+    out.putInt(train.seat_map_pos);
+  }
+
+  static void decode(RecordReader& in, Train& train) {
+    in.getString(train.train_id);
+    train.station_num = in.getInt();
+    train.seat_num = in.getInt();
+    int hour = 0;
+    for (int i = 0; i < train.station_num; ++i) {
+      in.getString(train.stations[i]);
+      train.prices[i] = in.getInt() + (i > 0 ? train.prices[i - 1] : 0);
+      train.arrival_times[i].hour = hour = in.getInt() + hour;
+      train.arrival_times[i].minute = in.getInt();
+      train.departure_times[i].hour = hour = in.getInt() + hour;
+      train.departure_times[i].minute = in.getInt();
+    }
+    in.getDate(train.sale_date_start);
+    in.getDate(train.sale_date_end);
+    train.type = in.getByte();
+    train.is_released = in.getByte();
+    train.seat_map_pos = in.getInt();
+  }
+};
+
+// The status is one plain byte, so that changing it keeps the length and
+// the record can be rewritten where it is.
+template <>
+struct RecordCodec<Order> {
+  static constexpr int max_size = 2 * encodedStringMax<20>() +
+                                  2 * encodedStringMax<30>() +
+                                  15 * VARINT32_MAX + 1;
+
+  static void putTimePoint(const TimePoint& point, RecordWriter& out) {
+    out.putDate(point.date);
+    out.putInt(point.time.hour);
+    out.putInt(point.time.minute);
+  }
+
+  static void getTimePoint(RecordReader& in, TimePoint& point) {
+    in.getDate(point.date);
+    point.time.hour = in.getInt();
+    point.time.minute = in.getInt();
+  }
+
+  static void encode(const Order& order, RecordWriter& out) {
+    out.putString(order.username);
+    out.putString(order.train_id);
+    out.putDate(order.origin_station_date);
+    out.putString(order.from);
+    out.putInt(order.start_station_index);
+    putTimePoint(order.start_time, out);
+    out.putString(order.to);
+    out.putInt(order.end_station_index);
+    putTimePoint(order.end_time, out);
+    out.putInt(order.ticket_num);
+    out.putInt(order.timestamp);
+    out.putInt(order.price);
+    out.putByte(order.status);
+  }
+
+  static void decode(RecordReader& in, Order& order) {
+    in.getString(order.username);
+    in.getString(order.train_id);
+    in.getDate(order.origin_station_date);
+    in.getString(order.from);
+    order.start_station_index = in.getInt();
+    getTimePoint(in, order.start_time);
+    in.getString(order.to);
+    order.end_station_index = in.getInt();
+    getTimePoint(in, order.end_time);
+    order.ticket_num = in.getInt();
+    order.timestamp = in.getInt();
+    order.price = in.getInt();
+    order.status = static_cast<OrderStatus>(in.getByte());
+  }
+};
+
+template <>
+struct RecordCodec<User> {
+  static constexpr int max_size = 2 * encodedStringMax<20>() +
+                                  2 * encodedStringMax<30>() + VARINT32_MAX;
+
+  static void encode(const User& user, RecordWriter& out) {
+    out.putString(user.username);
+    out.putString(user.password);
+    out.putString(user.name);
+    out.putString(user.mail_addr);
+    out.putInt(user.privilege);
+  }
+
+  static void decode(RecordReader& in, User& user) {
+    in.getString(user.username);
+    in.getString(user.password);
+    in.getString(user.name);
+    in.getString(user.mail_addr);
+    user.privilege = in.getInt();
+  }
+};
+
+template <>
+struct RecordCodec<OrderRef> {
+  static constexpr int max_size = VARINT32_MAX + VARINT64_MAX;
+
+  static void encode(const OrderRef& ref, RecordWriter& out) {
+    out.putInt(ref.timestamp);
+    out.putUint(ref.rid);
+  }
+
+  static void decode(RecordReader& in, OrderRef& ref) {
+    ref.timestamp = in.getInt();
+    ref.rid = in.getUint();
+  }
+};
@@ -0,0 +1,181 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "cache.hpp"
+#include "record_codec.hpp"
+#include "river.hpp"
+#include "slotted_page.hpp"
+
+// Records kept in their RecordCodec encoding in slotted pages, addressed by
+// record ids: the page offset plus the slot, which stays below the page
+// size that page offsets are multiples of. A record stays at its id until
+// it is erased, so indexes can hold ids instead of whole records. Records
+// are decoded only when read, so pages carry no padding and many more
+// records fit in the buffer pool. Pages go through the shared buffer pool
+// and so through the log. Pages with room are linked, through their next
+// field, from the first info int of the file; tag marks a linked page.
+template <class T>
+class RecordHeap {
+ public:
+  static constexpr int page_size = slottedPageSize(RecordCodec<T>::max_size);
+  using Page = SlottedPage<page_size>;
+  using PageRiver = River<Page, 2, page_size>;
+
+  // a page with this much room goes back on the list when records leave
+  static constexpr int relink_room = page_size / 4;
+
+  explicit RecordHeap(const std::string& filename)
+      : file_(filename), pages_(file_) {
+    if (!file_.exist()) {
+      file_.initialise();
+    }
+  }
+  ~RecordHeap() { pages_.flush(); }
+
+  // start over with an empty file
+  void initialise() {
+    pages_.reset();
+    file_.initialise();
+  }
+
+  RecordHeap(const RecordHeap&) = delete;
+  RecordHeap& operator=(const RecordHeap&) = delete;
+
+  uint64_t insert(const T& record) {
+    char buf[RecordCodec<T>::max_size];
+    RecordWriter out(buf);
+    RecordCodec<T>::encode(record, out);
+    int head;
+    pages_.get_info(head, 1);
+    while (true) {
+      if (head == 0) {
+        Page fresh{};
+        fresh.tag = 1;
+        head = pages_.write(fresh);
+        pages_.write_info(head, 1);
+      }
+      Page& page = pages_.pin_for_write(head);
+      int slot = page.add(buf, out.size(), true);
+      if (slot != -1) {
+        pages_.unpin(head, true);
+        return ridOf(head, slot);
+      }
+      // too full for this record, so it leaves the list
+      int next = page.next;
+      page.next = 0;
+      page.tag = 0;
+      pages_.unpin(head, true);
+      pages_.write_info(next, 1);
+      head = next;
+    }
+  }
+
+  void read(uint64_t rid, T& record) {
+    const Page& page = pages_.pin(pageOf(rid));
+    RecordReader in(page.data(slotOf(rid)));
+    RecordCodec<T>::decode(in, record);
+    pages_.unpin(pageOf(rid));
+  }
+
+  // rewrite the record at rid, false if it grew past the room left on its
+  // page; the record is then unchanged
+  bool update(uint64_t rid, const T& record) {
+    char buf[RecordCodec<T>::max_size];
+    RecordWriter out(buf);
+    RecordCodec<T>::encode(record, out);
+    Page& page = pages_.pin_for_write(pageOf(rid));
+    bool done = page.replace(slotOf(rid), buf, out.size());
+    pages_.unpin(pageOf(rid), done);
+    return done;
+  }
+
+  // the slot is handed out again, so rid must not be used any more
+  void erase(uint64_t rid) {
+    int page_addr = pageOf(rid);
+    Page& page = pages_.pin_for_write(page_addr);
+    page.erase(slotOf(rid));
+    bool relink = page.tag == 0 && page.room() >= relink_room;
+    if (relink) {
+      pages_.get_info(page.next, 1);
+      page.tag = 1;
+    }
+    pages_.unpin(page_addr, true);
+    if (relink) {
+      pages_.write_info(page_addr, 1);
+    }
+  }
+
+  // read the pages of records that are about to be read in one batch
+  void prefetch(const uint64_t* rids, int n) {
+    sjtu::vector<int> pages;
+    for (int i = 0; i < n; ++i) {
+      pages.push_back(pageOf(rids[i]));
+    }
+    if (n > 0) {
+      pages_.prefetch(&pages[0], n);
+    }
+  }
+
+  void flush() { pages_.flush(); }
+
+  // forget every cached page, see PagedFile::reset
+  void reset() { pages_.reset(); }
+
+ private:
+  PageRiver file_;
+  sjtu::PagedFile<Page, 2, page_size> pages_;
+
+  static uint64_t ridOf(int page, int slot) {
+    return static_cast<uint64_t>(page) + slot;
+  }
+  static int pageOf(uint64_t rid) { return rid / page_size * page_size; }
+  static int slotOf(uint64_t rid) { return rid % page_size; }
+};
+
+// Fills a fresh heap file page after page, writing the river directly
+// instead of going through the buffer pool, for rebuilds done between
+// checkpoints. Only the last page is left on the list of pages with room.
+template <class T>
+class RecordHeapBuilder {
+  using Page = typename RecordHeap<T>::Page;
+  static constexpr int page_size = RecordHeap<T>::page_size;
+
+ public:
+  explicit RecordHeapBuilder(const std::string& filename) : file_(filename) {
+    file_.initialise();
+  }
+  ~RecordHeapBuilder() {
+    if (addr_ != 0) {
+      page_.tag = 1;
+      file_.update(page_, addr_);
+      file_.write_info(addr_, 1);
+    }
+    file_.close();
+  }
+
+  RecordHeapBuilder(const RecordHeapBuilder&) = delete;
+  RecordHeapBuilder& operator=(const RecordHeapBuilder&) = delete;
+
+  // the record id of record in the finished heap
+  uint64_t add(const T& record) {
+    char buf[RecordCodec<T>::max_size];
+    RecordWriter out(buf);
+    RecordCodec<T>::encode(record, out);
+    int slot = addr_ == 0 ? -1 : page_.add(buf, out.size(), false);
+    if (slot == -1) {
+      if (addr_ != 0) {
+        file_.update(page_, addr_);
+      }
+      page_ = Page{};
+      addr_ = file_.allocate();
+      slot = page_.add(buf, out.size(), false);
+    }
+    return static_cast<uint64_t>(addr_) + slot;
+  }
+
+ private:
+  typename RecordHeap<T>::PageRiver file_;
+  Page page_{};
+  int addr_{0};
+};
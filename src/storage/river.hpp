@@ -0,0 +1,19 @@
+#pragma once
+
+#include "memory_river.hpp"
+
+// Storage backend shared by BPT and SeatManager, chosen at compile time.
+#ifdef USE_MMAP_RIVER
+#include "mapped_memory_river.hpp"
+
+template <class T, int info_len = 2, int align = 1>
+using River = MappedMemoryRiver<T, info_len, align>;
+#elif defined(USE_PREAD_RIVER)
+#include "file_memory_river.hpp"
+
+template <class T, int info_len = 2, int align = 1>
+using River = FileMemoryRiver<T, info_len, align>;
+#else
+template <class T, int info_len = 2, int align = 1>
+using River = MemoryRiver<T, info_len, align>;
+#endif
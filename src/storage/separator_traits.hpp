@@ -0,0 +1,22 @@
+#pragma once
+
+// Internal B+ tree nodes only route searches, so a separator keeps the key
+// and just enough of the value to order entries whose keys are equal. The
+// tie has to order values exactly like Value's own comparison does.
+// Specializations live next to their value types, so that every tree of a
+// type sees the same one.
+template <class Value>
+struct SeparatorTraits {
+  using Tie = Value;
+  static Tie tie(const Value& value) { return value; }
+};
+
+// Tie of a tree whose keys are unique: every value compares equal.
+struct NoTie {
+  bool operator<(const NoTie&) const { return false; }
+  bool operator>(const NoTie&) const { return false; }
+  bool operator==(const NoTie&) const { return true; }
+  bool operator!=(const NoTie&) const { return false; }
+  bool operator<=(const NoTie&) const { return true; }
+  bool operator>=(const NoTie&) const { return true; }
+};
@@ -0,0 +1,156 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+#include "index_block.hpp"
+
+// size of a page holding at least two records of max_record bytes: the
+// fewest whole NODE_PAGE_SIZE pages that do
+constexpr int slottedPageSize(int max_record) {
+  int pages = 1;
+  while (pages * static_cast<int>(NODE_PAGE_SIZE) - 12 <
+         2 * (max_record + 4)) {
+    pages++;
+  }
+  return pages * NODE_PAGE_SIZE;
+}
+
+// Page of variable-length records. A slot array grows from the front of
+// the body and the records from its end; a slot holds the offset and the
+// length of its record, and offset 0 marks a dead slot. Space freed by
+// erase or by shrinking a record is reclaimed by compacting the records
+// the next time a record does not fit.
+template <int PageSize>
+struct SlottedPage {
+  static constexpr int body_size = PageSize - 12;
+  static_assert(body_size < 65536, "slots address the body in 16 bits");
+
+  // free for the owner, e.g. a link to the next page of a list
+  int next;
+  int tag;
+  uint16_t slot_count;
+  // records occupy [data_start, body_size) of body, 0 in a fresh page
+  uint16_t data_start;
+  char body[body_size];
+
+  bool live(int slot) const { return offsetOf(slot) != 0; }
+  const char* data(int slot) const { return body + offsetOf(slot); }
+  char* data(int slot) { return body + offsetOf(slot); }
+  int length(int slot) const { return lengthOf(slot); }
+
+  // bytes a record added in a new slot may take
+  int room() const {
+    int used = slot_count * 4;
+    for (int i = 0; i < slot_count; ++i) {
+      used += lengthOf(i);
+    }
+    return body_size - used - 4;
+  }
+
+  // store a record in a new slot at the end, or with reuse in the first
+  // dead one; the slot, or -1 if the record does not fit
+  int add(const char* record, int len, bool reuse) {
+    int slot = slot_count;
+    if (reuse) {
+      for (int i = 0; i < slot_count; ++i) {
+        if (!live(i)) {
+          slot = i;
+          break;
+        }
+      }
+    }
+    int slots = slot == slot_count ? slot_count + 1 : slot_count;
+    if (!makeRoom(len, slots * 4)) {
+      return -1;
+    }
+    slot_count = slots;
+    place(slot, record, len);
+    return slot;
+  }
+
+  void erase(int slot) {
+    setSlot(slot, 0, 0);
+    while (slot_count > 0 && !live(slot_count - 1)) {
+      slot_count--;
+    }
+    if (slot_count == 0) {
+      data_start = body_size;
+    }
+  }
+
+  // erase slot and move the slots after it down by one, keeping their order
+  void eraseShift(int slot) {
+    memmove(body + slot * 4, body + (slot + 1) * 4,
+            (slot_count - slot - 1) * 4);
+    slot_count--;
+    if (slot_count == 0) {
+      data_start = body_size;
+    }
+  }
+
+  // rewrite the record of slot, false if the page has no room for it
+  bool replace(int slot, const char* record, int len) {
+    if (len <= lengthOf(slot)) {
+      memcpy(body + offsetOf(slot), record, len);
+      setSlot(slot, offsetOf(slot), len);
+      return true;
+    }
+    int old_offset = offsetOf(slot);
+    int old_len = lengthOf(slot);
+    setSlot(slot, 0, 0);
+    if (!makeRoom(len, slot_count * 4)) {
+      setSlot(slot, old_offset, old_len);
+      return false;
+    }
+    place(slot, record, len);
+    return true;
+  }
+
+ private:
+  int offsetOf(int slot) const {
+    uint16_t offset;
+    memcpy(&offset, body + slot * 4, 2);
+    return offset;
+  }
+  int lengthOf(int slot) const {
+    uint16_t len;
+    memcpy(&len, body + slot * 4 + 2, 2);
+    return len;
+  }
+  void setSlot(int slot, int offset, int len) {
+    uint16_t fields[2] = {static_cast<uint16_t>(offset),
+                          static_cast<uint16_t>(len)};
+    memcpy(body + slot * 4, fields, 4);
+  }
+
+  int start() const { return data_start == 0 ? body_size : data_start; }
+
+  void place(int slot, const char* record, int len) {
+    data_start = start() - len;
+    memcpy(body + data_start, record, len);
+    setSlot(slot, data_start, len);
+  }
+
+  // make len contiguous bytes free below the records, with slot_bytes of
+  // slots in front of them, compacting the records if that helps
+  bool makeRoom(int len, int slot_bytes) {
+    if (start() - slot_bytes >= len) {
+      return true;
+    }
+    if (room() + 4 - (slot_bytes - slot_count * 4) < len) {
+      return false;
+    }
+    char copy[body_size];
+    int end = body_size;
+    for (int i = 0; i < slot_count; ++i) {
+      if (live(i)) {
+        end -= lengthOf(i);
+        memcpy(copy + end, body + offsetOf(i), lengthOf(i));
+        setSlot(i, end, lengthOf(i));
+      }
+    }
+    memcpy(body + end, copy + end, body_size - end);
+    data_start = end;
+    return end - slot_bytes >= len;
+  }
+};
@@ -0,0 +1,353 @@
+#include "unique_bplus_tree.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+
+#include "../model/train.hpp"
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+bool UniqueBPT<Key, Value, ORDER, LEAF_SIZE>::get(const Key& key,
+                                                  Value& value) {
+  int addr = lookup(key);
+  if (addr == -1) {
+    return false;
+  }
+  values_.read(addr, value);
+  return true;
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+bool UniqueBPT<Key, Value, ORDER, LEAF_SIZE>::contains(const Key& key) {
+  return lookup(key) != -1;
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+bool UniqueBPT<Key, Value, ORDER, LEAF_SIZE>::put(const Key& key,
+                                                  const Value& value) {
+  if (root_ == -1) {
+    BlockNode new_block;
+    new_block.keys[0] = key;
+    new_block.values[0] = static_cast<int>(values_.insert(value));
+    new_block.size = 1;
+    root_ = cache_manager_.write_block(new_block);
+    cache_manager_.write_block_info(root_, 1);
+    height_ = 0;
+    saveRoot();
+    addToFilter(key);
+    return true;
+  }
+
+  sjtu::vector<PathFrame> path;
+  int leaf_addr = findLeafNode(key, path);
+  // the leaf has a spare slot, so the key goes straight into its page; the
+  // value record lives in another file and may be written meanwhile
+  BlockNode& leaf = cache_manager_.pin_block_for_write(leaf_addr);
+  int pos = leaf.size == 0 ? 0 : binarySearch(leaf.keys, key, 0, leaf.size - 1);
+  if (pos < leaf.size && leaf.keys[pos] == key) {
+    cache_manager_.unpin_block(leaf_addr);
+    return false;
+  }
+  for (int i = leaf.size; i > pos; --i) {
+    leaf.keys[i] = leaf.keys[i - 1];
+    leaf.values[i] = leaf.values[i - 1];
+  }
+  leaf.keys[pos] = key;
+  leaf.values[pos] = static_cast<int>(values_.insert(value));
+  leaf.size++;
+  if (leaf.size <= LEAF_SIZE) {
+    cache_manager_.unpin_block(leaf_addr, true);
+    addToFilter(key);
+    return true;
+  }
+
+  // split the full leaf, the right half goes to a new leaf
+  int mid = (LEAF_SIZE + 1) / 2;
+  BlockNode new_leaf;
+  new_leaf.size = LEAF_SIZE + 1 - mid;
+  for (int i = 0; i < new_leaf.size; ++i) {
+    new_leaf.keys[i] = leaf.keys[i + mid];
+    new_leaf.values[i] = leaf.values[i + mid];
+  }
+  leaf.size = mid;
+  new_leaf.next = leaf.next;
+  cache_manager_.unpin_block(leaf_addr, true);
+  int new_leaf_addr = cache_manager_.write_block(new_leaf);
+  cache_manager_.pin_block_for_write(leaf_addr).next = new_leaf_addr;
+  cache_manager_.unpin_block(leaf_addr, true);
+  insertIntoParent(path, path.size() - 1, new_leaf.keys[0], new_leaf_addr);
+  addToFilter(key);
+  return true;
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+bool UniqueBPT<Key, Value, ORDER, LEAF_SIZE>::update(const Key& key,
+                                                     const Value& value) {
+  int addr = lookup(key);
+  if (addr == -1) {
+    return false;
+  }
+  if (values_.update(addr, value)) {
+    return true;
+  }
+  // the record outgrew its page, so it moves and the leaf follows it
+  values_.erase(addr);
+  int moved = static_cast<int>(values_.insert(value));
+  int leaf_addr = descend(key);
+  BlockNode& leaf = cache_manager_.pin_block_for_write(leaf_addr);
+  leaf.values[binarySearch(leaf.keys, key, 0, leaf.size - 1)] = moved;
+  cache_manager_.unpin_block(leaf_addr, true);
+  return true;
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+bool UniqueBPT<Key, Value, ORDER, LEAF_SIZE>::erase(const Key& key) {
+  sjtu::vector<PathFrame> path;
+  // nothing will climb the path when merges are deferred
+  int leaf_addr = defer_merges_ ? descend(key) : findLeafNode(key, path);
+  if (leaf_addr == -1) {
+    return false;
+  }
+  BlockNode& page = cache_manager_.pin_block_for_write(leaf_addr);
+  int pos = page.size == 0 ? 0 : binarySearch(page.keys, key, 0, page.size - 1);
+  if (pos >= page.size || page.keys[pos] != key) {
+    cache_manager_.unpin_block(leaf_addr);
+    return false;
+  }
+  values_.erase(page.values[pos]);
+  for (int i = pos; i < page.size - 1; ++i) {
+    page.keys[i] = page.keys[i + 1];
+    page.values[i] = page.values[i + 1];
+  }
+  page.size--;
+  if (page.size >= (LEAF_SIZE + 1) / 3 || (defer_merges_ && height_ > 0)) {
+    cache_manager_.unpin_block(leaf_addr, true);
+    return true;
+  }
+  // rebalancing reads and writes siblings, so it works on a copy
+  BlockNode leaf = page;
+  cache_manager_.unpin_block(leaf_addr, true);
+  balanceLeaf(leaf, leaf_addr, path, LEAF_SIZE, moveEntry, firstKey);
+  return true;
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+int UniqueBPT<Key, Value, ORDER, LEAF_SIZE>::descend(const Key& key) {
+  int ptr = root_;
+  for (int level = 1; ptr != -1 && level <= height_; level++) {
+    const IndexNode& index = cache_manager_.pin_index(ptr);
+    int next = index.children[binarySearchForBigOrEqual(index.keys, key, 0,
+                                                        index.size - 1)];
+    cache_manager_.unpin_index(ptr);
+    ptr = next;
+  }
+  return ptr;
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+int UniqueBPT<Key, Value, ORDER, LEAF_SIZE>::lookup(const Key& key) {
+  if (filtered_ && !filter_.mayContain(filterHash(key))) {
+    return -1;
+  }
+  int ptr = descend(key);
+  int addr = ptr == -1 ? -1 : findInLeaf(ptr, key);
+  if (filtered_ && addr == -1) {
+    filter_.recordFalsePositive();
+  }
+  return addr;
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+int UniqueBPT<Key, Value, ORDER, LEAF_SIZE>::findInLeaf(int leaf_addr,
+                                                        const Key& key) {
+  const BlockNode& block = cache_manager_.pin_block(leaf_addr);
+  int addr = -1;
+  if (block.size > 0) {
+    int pos = binarySearch(block.keys, key, 0, block.size - 1);
+    if (pos < block.size && block.keys[pos] == key) {
+      addr = block.values[pos];
+    }
+  }
+  cache_manager_.unpin_block(leaf_addr);
+  return addr;
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+void UniqueBPT<Key, Value, ORDER, LEAF_SIZE>::prefetch(const Key* keys,
+                                                       size_t n) {
+  if (n == 0 || root_ == -1) {
+    return;
+  }
+  sjtu::vector<int> leaves;
+  for (size_t i = 0; i < n; ++i) {
+    leaves.push_back(descend(keys[i]));
+  }
+  cache_manager_.prefetch_blocks(&leaves[0], n);
+  sjtu::vector<uint64_t> records;
+  for (size_t i = 0; i < n; ++i) {
+    int addr = findInLeaf(leaves[i], keys[i]);
+    if (addr != -1) {
+      records.push_back(addr);
+    }
+  }
+  if (!records.empty()) {
+    values_.prefetch(&records[0], records.size());
+  }
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+void UniqueBPT<Key, Value, ORDER, LEAF_SIZE>::addToFilter(const Key& key) {
+  if (!filtered_) {
+    return;
+  }
+  filter_.add(filterHash(key));
+  if (filter_.full()) {
+    rebuildFilter();
+  }
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+void UniqueBPT<Key, Value, ORDER, LEAF_SIZE>::rebuildFilter() {
+  // the header page is never a node, and a chain that leaves the block
+  // file or has more leaves than the file has slots runs in a cycle; a
+  // filter built from either would hide keys, so give up instead
+  if (root_ == 0 || root_ < -1) {
+    corrupted("root");
+  }
+  int leaf_addr = leftmostLeaf();
+  int slots = block_file_.slots();
+  int leaves = 0;
+  size_t total = 0;
+  for (int ptr = leaf_addr; ptr != -1; ++leaves) {
+    int slot = (ptr - BlockRiver::data_offset) / BlockRiver::stride;
+    if (leaves == slots || ptr < BlockRiver::data_offset || slot >= slots ||
+        (ptr - BlockRiver::data_offset) % BlockRiver::stride != 0) {
+      corrupted("leaf chain");
+    }
+    const BlockNode& block = cache_manager_.pin_block(ptr);
+    total += block.size;
+    int next = block.next;
+    cache_manager_.unpin_block(ptr);
+    ptr = next;
+  }
+
+  // twice the keys there are now, so it takes as many again before the
+  // next rebuild
+  filter_.reset(total * 2 < BLOOM_MIN_KEYS ? BLOOM_MIN_KEYS : total * 2);
+  for (int ptr = leaf_addr; leaves > 0; --leaves) {
+    const BlockNode& block = cache_manager_.pin_block(ptr);
+    for (size_t i = 0; i < block.size; ++i) {
+      filter_.add(filterHash(block.keys[i]));
+    }
+    int next = block.next;
+    cache_manager_.unpin_block(ptr);
+    ptr = next;
+  }
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+void UniqueBPT<Key, Value, ORDER, LEAF_SIZE>::corrupted(const char* what) {
+  std::cerr << filename_ << ": corrupt " << what << '\n';
+  exit(1);
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+bool UniqueBPT<Key, Value, ORDER, LEAF_SIZE>::empty() {
+  // with merges deferred, leaves may stay behind with nothing in them
+  for (int ptr = leftmostLeaf(); ptr != -1;) {
+    const BlockNode& block = cache_manager_.pin_block(ptr);
+    size_t size = block.size;
+    int next = block.next;
+    cache_manager_.unpin_block(ptr);
+    if (size > 0) {
+      return false;
+    }
+    ptr = next;
+  }
+  return true;
+}
+
+template <class Key, class Value, size_t ORDER, size_t LEAF_SIZE>
+void UniqueBPT<Key, Value, ORDER, LEAF_SIZE>::compact() {
+  std::string index_tmp = filename_ + ".index.tmp";
+  std::string block_tmp = filename_ + ".block.tmp";
+  std::string value_tmp = filename_ + ".values.tmp";
+  int new_root = -1;
+  int new_height = 0;
+  {
+    IndexRiver new_index(index_tmp);
+    BlockRiver new_block(block_tmp);
+    RecordHeapBuilder<Value> new_values(value_tmp);
+    new_index.initialise();
+    new_block.initialise();
+
+    // number of live entries
+    int leaf_addr = leftmostLeaf();
+    size_t total = 0;
+    for (int ptr = leaf_addr; ptr != -1;) {
+      const BlockNode& block = cache_manager_.pin_block(ptr);
+      total += block.size;
+      int next = block.next;
+      cache_manager_.unpin_block(ptr);
+      ptr = next;
+    }
+
+    // leaves, filled evenly and chained in key order; values are copied
+    // in the same order so that neighbouring keys share value pages
+    sjtu::vector<Key> first_keys;
+    sjtu::vector<int> addrs;
+    size_t leaf_count = (total + LEAF_SIZE - 1) / LEAF_SIZE;
+    int src_addr = leaf_addr;
+    size_t src_idx = 0;
+    BlockNode prev;
+    int prev_addr = -1;
+    Value value;
+    for (size_t i = 0; i < leaf_count; ++i) {
+      size_t count = total / leaf_count + (i < total % leaf_count ? 1 : 0);
+      BlockNode leaf;
+      const BlockNode* src = &cache_manager_.pin_block(src_addr);
+      while (leaf.size < count) {
+        if (src_idx == src->size) {
+          int next = src->next;
+          cache_manager_.unpin_block(src_addr);
+          src_addr = next;
+          src = &cache_manager_.pin_block(src_addr);
+          src_idx = 0;
+          continue;
+        }
+        values_.read(src->values[src_idx], value);
+        leaf.keys[leaf.size] = src->keys[src_idx++];
+        leaf.values[leaf.size++] = static_cast<int>(new_values.add(value));
+      }
+      cache_manager_.unpin_block(src_addr);
+      int addr = new_block.write(leaf);
+      if (prev_addr != -1) {
+        prev.next = addr;
+        new_block.update(prev, prev_addr);
+      } else {
+        new_block.write_info(addr, 1);
+      }
+      first_keys.push_back(leaf.keys[0]);
+      addrs.push_back(addr);
+      prev = leaf;
+      prev_addr = addr;
+    }
+
+    buildIndex(new_index, first_keys, addrs, new_root, new_height);
+    new_index.write_info(new_root, 1);
+    new_index.write_info(new_height, 2);
+  }
+
+  cache_manager_.reset();
+  values_.reset();
+  swapFiles();
+  root_ = new_root;
+  height_ = new_height;
+  // erased keys leave the filter here
+  if (filtered_) {
+    rebuildFilter();
+  }
+}
+
+template class UniqueBPT<FixedString<20>, Train>;
@@ -0,0 +1,127 @@
+#pragma once
+#include <string>
+
+#include "../stl/vector.hpp"
+#include "bloom_filter.hpp"
+#include "bplus_tree_base.hpp"
+#include "index_block.hpp"
+#include "record_heap.hpp"
+
+// B+ tree for tables that map every key to exactly one value. Nodes hold
+// bare keys, and values live out of line in <filename>.values, so leaves
+// stay small and a point lookup reads one leaf and one value record.
+// A tree opened with filtered set keeps a Bloom filter over its keys in
+// <filename>.bloom, so lookups of absent keys mostly read no node at all.
+template <class Key, class Value, size_t ORDER = defaultUniqueOrder<Key>(),
+          size_t LEAF_SIZE = defaultUniqueOrder<Key>()>
+class UniqueBPT : public BPTBase<UniqueIndex<Key, ORDER>,
+                                 UniqueBlock<Key, LEAF_SIZE>, Key, ORDER> {
+  using IndexNode = UniqueIndex<Key, ORDER>;
+  using BlockNode = UniqueBlock<Key, LEAF_SIZE>;
+  using Base = BPTBase<IndexNode, BlockNode, Key, ORDER>;
+  using typename Base::BlockRiver;
+  using typename Base::IndexRiver;
+  using typename Base::PathFrame;
+
+ public:
+  UniqueBPT(const std::string& filename = "database", bool filtered = false)
+      : Base(filename, FILES, 3),
+        values_(filename + ".values"),
+        filter_(filename + ".bloom"),
+        filtered_(filtered) {
+    if (created_) {
+      values_.initialise();
+    }
+    // a filter left by an earlier, removed tree must not be trusted
+    if (filtered_ && (created_ || !filter_.load())) {
+      rebuildFilter();
+    }
+  }
+  ~UniqueBPT() {
+    cache_manager_.flush_cache();
+    values_.flush();
+    if (filtered_) {
+      filter_.save();
+    }
+  }
+
+  // copy the value of key out, false if key is absent
+  bool get(const Key& key, Value& value);
+  bool contains(const Key& key);
+  // insert a new key, false if key is already present
+  bool put(const Key& key, const Value& value);
+  // overwrite the value record in place, false if key is absent
+  bool update(const Key& key, const Value& value);
+  // false if key is absent
+  bool erase(const Key& key);
+  bool empty();
+
+  // read the leaves, then the value records, of keys in two batches, so
+  // that the lookups that follow are answered from the buffer pool
+  void prefetch(const Key* keys, size_t n);
+
+  // rewrite all three files densely, dropping every recycled slot
+  void compact();
+
+  // leave underfull and empty leaves in place on erase, see BPT
+  void deferMerges(bool on) { defer_merges_ = on; }
+
+  // internal node reads answered from memory, and those that went to the
+  // buffer pool, see BPT_RESIDENT_INDEX
+  size_t residentIndexHits() const { return cache_manager_.residentHits(); }
+  size_t residentIndexLoads() const { return cache_manager_.residentLoads(); }
+
+  // lookups the filter answered, and those it let through for absent keys
+  size_t filterQueries() const { return filter_.queries(); }
+  size_t filterNegatives() const { return filter_.negatives(); }
+  size_t filterFalsePositives() const { return filter_.falsePositives(); }
+
+ private:
+  using Base::block_file_;
+  using Base::cache_manager_;
+  using Base::created_;
+  using Base::filename_;
+  using Base::height_;
+  using Base::index_file_;
+  using Base::root_;
+  using Base::balanceLeaf;
+  using Base::buildIndex;
+  using Base::findLeafNode;
+  using Base::insertIntoParent;
+  using Base::leftmostLeaf;
+  using Base::saveRoot;
+  using Base::swapFiles;
+
+  RecordHeap<Value> values_;
+  BloomFilter filter_;
+  bool filtered_;
+  bool defer_merges_{false};
+
+  // files compact replaces together
+  static constexpr const char* FILES[] = {".index", ".block", ".values"};
+
+  // add a key that was just put, rebuilding a filter that has filled up
+  void addToFilter(const Key& key);
+
+  // size the filter for the current keys and add every one of them
+  void rebuildFilter();
+
+  // report a tree whose files cannot be walked and stop
+  void corrupted(const char* what);
+
+  // descend to the only leaf that may hold key, without copying nodes
+  int descend(const Key& key);
+
+  // address of the value record of key, or -1
+  int lookup(const Key& key);
+
+  // address of the value record of key within one leaf, or -1
+  int findInLeaf(int leaf_addr, const Key& key);
+
+  // leaf layout, for balanceLeaf
+  static void moveEntry(BlockNode& to, int i, const BlockNode& from, int j) {
+    to.keys[i] = from.keys[j];
+    to.values[i] = from.values[j];
+  }
+  static Key firstKey(const BlockNode& leaf) { return leaf.keys[0]; }
+};
@@ -0,0 +1,250 @@
+#include "wal.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer_pool.hpp"
+
+// sanity bounds for records read back during recovery
+constexpr int MAX_NAME_LEN = 256;
+constexpr int MAX_PAGE_SIZE = 1 << 24;
+
+WriteAheadLog& WriteAheadLog::instance() {
+  static WriteAheadLog wal;
+  return wal;
+}
+
+WriteAheadLog::WriteAheadLog()
+    : mode_(WAL_MODE), file_name_("storage.wal") {
+#ifdef USE_MMAP_RIVER
+  // mapped pages reach their files whenever the kernel decides to, so the
+  // log could never be written ahead of them
+  mode_ = WAL_NONE;
+#endif
+}
+
+WriteAheadLog::~WriteAheadLog() {
+  if (fd_ == -1) {
+    return;
+  }
+  // every manager has written its pages back by now, so once the files
+  // are on disk the log is no longer needed
+  sync();
+  for (size_t i = 0; i < files_.size(); ++i) {
+    syncFile(files_[i]);
+  }
+  truncate();
+  ::close(fd_);
+}
+
+void WriteAheadLog::setMode(DurabilityMode mode) {
+#ifndef USE_MMAP_RIVER
+  if (mode_ != WAL_NONE && mode == WAL_NONE) {
+    checkpoint();
+  }
+  // commands of a group commit wait for a deadline only that mode keeps
+  if (group_commands_ > 0) {
+    sync();
+  }
+  mode_ = mode;
+#endif
+}
+
+void WriteAheadLog::trackFile(const std::string& file_name) {
+  for (size_t i = 0; i < files_.size(); ++i) {
+    if (files_[i] == file_name) {
+      return;
+    }
+  }
+  files_.push_back(file_name);
+}
+
+void WriteAheadLog::recover() {
+  int fd = ::open(file_name_.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return;
+  }
+  struct Target {
+    std::string name;
+    int fd;
+  };
+  sjtu::vector<Target> targets;
+  std::string command;  // records of the command being read
+  int records = 0;
+  RecordHeader header;
+  while (::read(fd, &header, sizeof(header)) == sizeof(header)) {
+    if (header.type == COMMIT_RECORD) {
+      if (header.addr != records) {
+        break;
+      }
+      // the command is complete, apply its pages
+      size_t pos = 0;
+      while (pos < command.size()) {
+        RecordHeader page;
+        command.copy(reinterpret_cast<char*>(&page), sizeof(page), pos);
+        pos += sizeof(page);
+        std::string name = command.substr(pos, page.name_len);
+        pos += page.name_len;
+        int target = -1;
+        for (size_t i = 0; i < targets.size(); ++i) {
+          if (targets[i].name == name) {
+            target = targets[i].fd;
+          }
+        }
+        if (target == -1) {
+          target = ::open(name.c_str(), O_RDWR | O_CREAT, 0644);
+          targets.push_back(Target{name, target});
+        }
+        pwrite(target, command.data() + pos, page.size, page.addr);
+        pos += page.size;
+      }
+      command.clear();
+      records = 0;
+      continue;
+    }
+    if (header.type != PAGE_RECORD || header.name_len <= 0 ||
+        header.name_len > MAX_NAME_LEN || header.size <= 0 ||
+        header.size > MAX_PAGE_SIZE || header.addr < 0) {
+      break;
+    }
+    // a torn tail ends the log, whatever follows it was never committed
+    std::string body(header.name_len + header.size, '\0');
+    if (::read(fd, &body[0], body.size()) != (ssize_t)body.size()) {
+      break;
+    }
+    command.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    command.append(body);
+    records++;
+  }
+  ::close(fd);
+  for (size_t i = 0; i < targets.size(); ++i) {
+    fsync(targets[i].fd);
+    ::close(targets[i].fd);
+  }
+  open();
+  truncate();
+}
+
+void WriteAheadLog::commit() {
+  if (!enabled()) {
+    return;
+  }
+  BufferPool::instance().commitPages(*this);
+  if (command_records_ == 0) {
+    return;  // nothing changed, e.g. a query
+  }
+  RecordHeader header{COMMIT_RECORD, 0, command_records_, 0};
+  append(header, nullptr, nullptr);
+  command_records_ = 0;
+  commits_++;
+  if (group_commands_++ == 0) {
+    pending_since_ = nowMs();
+  }
+  if (mode_ == WAL_PER_COMMAND || group_commands_ >= WAL_GROUP_COMMANDS ||
+      nowMs() - pending_since_ >= WAL_GROUP_MS) {
+    sync();
+  }
+  if (log_size_ + buffer_.size() >= WAL_CHECKPOINT_BYTES) {
+    checkpoint();
+  }
+}
+
+void WriteAheadLog::awaitInput(int fd) {
+  if (!enabled() || group_commands_ == 0) {
+    return;
+  }
+  long long wait = pending_since_ + WAL_GROUP_MS - nowMs();
+  if (wait > 0) {
+    pollfd input{fd, POLLIN, 0};
+    if (poll(&input, 1, static_cast<int>(wait)) > 0) {
+      return;  // the next command commits in time to sync the group
+    }
+  }
+  sync();
+}
+
+long long WriteAheadLog::nowMs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+void WriteAheadLog::checkpoint() {
+  if (!enabled()) {
+    return;
+  }
+  sync();
+  BufferPool::instance().flushAll();
+  for (size_t i = 0; i < files_.size(); ++i) {
+    syncFile(files_[i]);
+  }
+  truncate();
+  checkpoints_++;
+}
+
+void WriteAheadLog::logPage(const std::string& file_name, int addr,
+                            const char* data, int size) {
+  RecordHeader header{PAGE_RECORD, static_cast<int>(file_name.size()), addr,
+                      size};
+  append(header, file_name.data(), data);
+  command_records_++;
+}
+
+void WriteAheadLog::syncBeforeWriteBack() {
+  if (enabled() && !buffer_.empty()) {
+    sync();
+  }
+}
+
+void WriteAheadLog::syncFile(const std::string& file_name) {
+  int fd = ::open(file_name.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return;
+  }
+  fsync(fd);
+  ::close(fd);
+}
+
+void WriteAheadLog::open() {
+  if (fd_ != -1) {
+    return;
+  }
+  fd_ = ::open(file_name_.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  log_size_ = lseek(fd_, 0, SEEK_END);
+}
+
+void WriteAheadLog::append(const RecordHeader& header, const char* name,
+                           const char* data) {
+  buffer_.append(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (name != nullptr) {
+    buffer_.append(name, header.name_len);
+    buffer_.append(data, header.size);
+  }
+}
+
+void WriteAheadLog::sync() {
+  open();
+  size_t written = 0;
+  while (written < buffer_.size()) {
+    ssize_t n =
+        ::write(fd_, buffer_.data() + written, buffer_.size() - written);
+    if (n <= 0) {
+      break;
+    }
+    written += n;
+  }
+  log_size_ += written;
+  buffer_.clear();
+  fdatasync(fd_);
+  group_commands_ = 0;
+  syncs_++;
+}
+
+void WriteAheadLog::truncate() {
+  open();
+  ftruncate(fd_, 0);
+  fsync(fd_);
+  log_size_ = 0;
+}
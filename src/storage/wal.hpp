@@ -0,0 +1,114 @@
+#ifndef BPT_WAL_HPP
+#define BPT_WAL_HPP
+
+#include <cstddef>
+#include <string>
+
+#include "../stl/vector.hpp"
+
+enum DurabilityMode {
+  WAL_NONE = 0,
+  WAL_PER_COMMAND = 1,
+  WAL_GROUP_COMMIT = 2
+};
+
+// Durability of committed commands, override with -DWAL_MODE=... or
+// WriteAheadLog::setMode at runtime. A group commit syncs the log once
+// WAL_GROUP_COMMANDS commands have piled up, and at the latest
+// WAL_GROUP_MS milliseconds after the first of them committed, also when
+// no further command arrives, see awaitInput.
+#ifndef WAL_MODE
+#define WAL_MODE WAL_GROUP_COMMIT
+#endif
+#ifndef WAL_GROUP_COMMANDS
+#define WAL_GROUP_COMMANDS 128
+#endif
+#ifndef WAL_GROUP_MS
+#define WAL_GROUP_MS 50
+#endif
+// the log is checkpointed and truncated once it grows past this size
+#ifndef WAL_CHECKPOINT_BYTES
+#define WAL_CHECKPOINT_BYTES (64u << 20)
+#endif
+
+// Redo log shared by every pooled storage file. A command's changes are
+// logged as after-images of the pages it dirtied, followed by a commit
+// record. Data files only receive pages when the buffer pool evicts them
+// or at a checkpoint, and a page is never written back before the log
+// records describing it are on disk. Recovery replays every committed
+// command found in the log.
+class WriteAheadLog {
+ public:
+  static WriteAheadLog& instance();
+
+  void setMode(DurabilityMode mode);
+  DurabilityMode mode() const { return mode_; }
+  bool enabled() const { return mode_ != WAL_NONE; }
+
+  // replay the log into the data files, must run before any file is opened
+  void recover();
+  // end of a command: log the pages it dirtied and sync as the mode asks
+  void commit();
+  // called before blocking on fd for the next command when none is ready:
+  // waits for input only until the oldest unsynced command is due, then
+  // syncs, so an idle process keeps the group commit deadline without a
+  // thread of its own
+  void awaitInput(int fd);
+  // write every dirty page to its file, sync the files and empty the log
+  void checkpoint();
+
+  // called by BufferPool::commitPages from within commit
+  void logPage(const std::string& file_name, int addr, const char* data,
+               int size);
+  // a dirty page is about to reach its file, its records must be durable
+  void syncBeforeWriteBack();
+
+  // remember a data file so that checkpoints sync it
+  void trackFile(const std::string& file_name);
+  static void syncFile(const std::string& file_name);
+
+  size_t commits() const { return commits_; }
+  size_t syncs() const { return syncs_; }
+  size_t checkpoints() const { return checkpoints_; }
+
+ private:
+  struct RecordHeader {
+    int type;  // PAGE_RECORD or COMMIT_RECORD
+    int name_len;
+    int addr;  // page offset, or the command's page count in a commit
+    int size;
+  };
+  static constexpr int PAGE_RECORD = 1;
+  static constexpr int COMMIT_RECORD = 2;
+
+  DurabilityMode mode_;
+  std::string file_name_;
+  int fd_{-1};
+  sjtu::vector<std::string> files_;
+  std::string buffer_;       // records not yet written to the log file
+  size_t log_size_{0};       // bytes in the log file
+  int command_records_{0};   // page records of the running command
+  int group_commands_{0};    // commits since the last sync
+  // commit time of the oldest command that is not synced yet, see nowMs
+  long long pending_since_{0};
+
+  size_t commits_{0};
+  size_t syncs_{0};
+  size_t checkpoints_{0};
+
+  WriteAheadLog();
+  ~WriteAheadLog();
+  WriteAheadLog(const WriteAheadLog&) = delete;
+  WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+  // milliseconds on a monotonic clock
+  static long long nowMs();
+
+  void open();
+  void append(const RecordHeader& header, const char* name,
+              const char* data);
+  void sync();
+  void truncate();
+};
+
+#endif  // BPT_WAL_HPP
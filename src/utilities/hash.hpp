@@ -80,4 +80,12 @@ class Hash {
 
     return hash ^ dateHash;
   }
+
+  // only from is mixed, so a route and its reverse hash apart
+  static uint64_t hashKey(const FixedString<30>& from,
+                          const FixedString<30>& to) {
+    uint64_t hash = hashKey<30>(from);
+    hash = (hash ^ (hash >> 31)) * 0x9E3779B97F4A7C15ULL;
+    return hash ^ hashKey<30>(to);
+  }
 };
\ No newline at end of file
@@ -1,7 +1,12 @@
 #pragma once
+#include <cstdint>
 #include <cstring>
 #include <string>
 
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "FixedString::prefix assumes a little-endian host"
+#endif
+
 template <size_t N>
 struct FixedString {
   char string[N + 1];
@@ -26,28 +31,57 @@ struct FixedString {
     }
   }
 
+  // The first 8 characters as a big-endian word, zero past the end, so
+  // that prefixes compare like the strings they start.
+  uint64_t prefix() const {
+    uint64_t word = 0;
+    memcpy(&word, string, N + 1 < 8 ? N + 1 : 8);
+    if (length < 8) {
+      word &= (uint64_t(1) << (8 * length)) - 1;
+    }
+    return __builtin_bswap64(word);
+  }
+
+  // negative, zero or positive, in the same order as strcmp; most keys
+  // differ within the prefix and never reach memcmp
+  int compare(const FixedString& other) const {
+    uint64_t a = prefix();
+    uint64_t b = other.prefix();
+    if (a != b) {
+      return a < b ? -1 : 1;
+    }
+    size_t common = length < other.length ? length : other.length;
+    if (common > 8) {
+      int cmp = memcmp(string + 8, other.string + 8, common - 8);
+      if (cmp != 0) {
+        return cmp;
+      }
+    }
+    return length < other.length ? -1 : (length > other.length ? 1 : 0);
+  }
+
   bool operator<(const FixedString& other) const {
-    return strcmp(string, other.string) < 0;
+    return compare(other) < 0;
   }
 
   bool operator>(const FixedString& other) const {
-    return strcmp(string, other.string) > 0;
+    return compare(other) > 0;
   }
 
   bool operator==(const FixedString& other) const {
-    return strcmp(string, other.string) == 0;
+    return length == other.length && memcmp(string, other.string, length) == 0;
   }
 
   bool operator!=(const FixedString& other) const {
-    return strcmp(string, other.string) != 0;
+    return !(*this == other);
   }
 
   bool operator<=(const FixedString& other) const {
-    return strcmp(string, other.string) <= 0;
+    return compare(other) <= 0;
   }
 
   bool operator>=(const FixedString& other) const {
-    return strcmp(string, other.string) >= 0;
+    return compare(other) >= 0;
   }
 
   FixedString& operator=(const std::string& other) {